@@ -6,8 +6,51 @@ const int DEFAULT_MIN_SAMPLE_LEAF = 1;
 const int DEFAULT_N_TREES = 10;
 const int DEFAULT_N_THREADS = 1;
 
+/* histogram split parameter */
+const int DEFAULT_MAX_BINS = 255;
+
+/* how the tree chooses thresholds when split a node */
+enum split_mode {BEST_SPLIT, HISTOGRAM_SPLIT, RANDOM_SPLIT};
+
+/* a random threshold is one of this many evenly spaced points between the minimum and the maximum value of the node */
+const int RANDOM_SPLIT_RESOLUTION = 1 << 30;
+
+/* how the tree is grown, node by node in depth-first order or a whole depth at a time */
+enum grow_mode {DEPTH_FIRST, LEVEL_WISE};
+
+/* a node with this many examples spreads its candidate features over the threads of its tree */
+const int PARALLEL_SPLIT_MIN_EXAMPLES = 1 << 15;
+
+/* a subtree with this many examples is built as a task, which an idle worker may steal */
+const int TASK_MIN_EXAMPLES = 1 << 12;
+
+/* a node of `HISTOGRAM_SPLIT` keeps its histograms for its children if they may derive at least this fraction of theirs */
+const double HIST_KEEP_MIN_REUSE = 0.25;
+
+/* categorical features take the values 0, 1, ..., `MAX_CATEGORIES`-1, a node sends a set of them to the left child */
+const int MAX_CATEGORIES = 1 << 16;
+
+/* number of entries decoded at a time from a compressed column */
+const int COLUMN_BLOCK_SIZE = 256;
+
 /* forest export_dotfile parameter */
 enum dotfile_mode {SEPARATE_TREES, WHOLE_FOREST};
 
 /* dataset read mode */
 enum learn_mode {TRAIN, TEST};
+
+/* input file format, `DENSE` is comma or tab separated values with the label in the first column */
+enum data_format {LIBSVM, DENSE};
+
+/* compression of the input file, detected by the magic bytes */
+enum input_compression {NO_COMPRESSION, GZIP_COMPRESSION, XZ_COMPRESSION, ZSTD_COMPRESSION};
+
+/* a compressed input file is parsed in chunks of this size as soon as they are decompressed */
+const size_t STREAM_CHUNK_SIZE = 16 << 20;
+
+/* dataset cache file parameter */
+const char DATASET_CACHE_MAGIC[8] = "RFCACHE";
+/* version 2: `is_cate` is meaningful, the flags of a version 1 cache may be garbage */
+/* version 3: a shared segment stores the dense columns at `dense_offset` */
+/* version 4: the label map of `load_data` follows `y`, so `append` can change the labels of the new examples */
+const int DATASET_CACHE_VERSION = 4;
@@ -11,9 +11,31 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
 #include <cstdlib>
 #include <fstream>
 #include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <cerrno>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <condition_variable>
+/* POSIX header file */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+/* compression library header files */
+#include <zlib.h>
+#include <lzma.h>
+#ifdef RF_WITH_ZSTD
+#include <zstd.h>
+#endif
 
 #include "utils.h"
 #include "constant.h"
@@ -30,10 +52,34 @@ typedef struct {
 	}
 }ev_pair_t;
 
+/**
+ * @brief Header of the binary dataset cache file, followed by `size`, `valid_features`, `is_cate`, `y`, 
+ * `n_label_map` (label, class) pairs of `label_map` and finally all the columns of `x` (at `data_offset`, page aligned). A shared segment stores the dense 
+ * columns as `dense_value` and `order` arrays at `dense_offset` instead of as pairs in `x`.
+ */
+typedef struct {
+	char magic[8]; 			/** `DATASET_CACHE_MAGIC` */
+	int version; 			/** `DATASET_CACHE_VERSION` */
+	int feature_size; 		/** sizeof(feature_t) */
+	int target_size; 		/** sizeof(target_t) */
+	int n_classes; 			/** number of classes */
+	int n_examples; 		/** number of examples */
+	int n_features; 		/** number of features */
+	int n_valid; 			/** number of valid features */
+	int n_dense; 			/** number of dense columns stored at `dense_offset`, 0 if they are pairs in `x` */
+	int n_label_map; 		/** number of entries of `label_map` */
+	long long nnz; 			/** total number of entries in `x` */
+	long long source_size; 	/** size of the source file when the cache is built */
+	long long source_mtime; /** modify time of the source file when the cache is built */
+	long long data_offset; 	/** offset of `x` in the cache file */
+	long long dense_offset; /** offset of all the `dense_value` columns, followed by all the `order` columns */
+}cache_header_t;
+
 class example_t {
 	public:
 		target_t y; /** example label*/
 		int nnz; 	/** number of non-zero attribute in this example */
+		int capacity; 	/** allocated length of `fea_id` and `fea_value` */
 		int* fea_id; 	/** array of non-zero feature id */
 		feature_t* fea_value; /** array of non-zero feature value */
 
@@ -52,45 +98,465 @@ class example_t {
 		 * @param value feature value
 		 */
 		void push_back(int id, feature_t value);
+		/**
+		 * @brief assign replace the content of this example with `nnz` entries in one allocation
+		 *
+		 * @param nnz number of entries
+		 * @param id array of feature id
+		 * @param value array of feature value
+		 */
+		void assign(int nnz, const int* id, const feature_t* value);
 		/**
 		 * @brief debug print some information for debugging
 		 */
 		void debug();
 };
 
+/**
+ * @brief A batch of examples in compressed sparse row format, non-zero entries of the ith example
+ * are `fea_id[row_ptr[i]]` ~ `fea_id[row_ptr[i+1]-1]` (same for `fea_value`)
+ */
+class example_batch {
+	public:
+		std::vector<target_t> y; 			/** label for each example (-1 in `TEST` mode) */
+		std::vector<size_t> row_ptr; 		/** offset of each example in `fea_id` and `fea_value`, size is `n_examples`+1 */
+		std::vector<int> fea_id; 			/** feature id of all the non-zero entries */
+		std::vector<feature_t> fea_value; 	/** feature value of all the non-zero entries */
+
+		/**
+		 * @brief example_batch constructor
+		 */
+		example_batch();
+		/**
+		 * @brief example_batch constructor, pack the examples into one batch
+		 *
+		 * @param examples examples to pack
+		 */
+		example_batch(const std::vector<example_t*>& examples);
+		/**
+		 * @brief push_back append an example to the end of the batch
+		 *
+		 * @param ex example to append
+		 */
+		void push_back(const example_t& ex);
+		/**
+		 * @brief clear remove all the examples
+		 */
+		void clear();
+		/**
+		 * @brief get_n_examples number of examples in the batch
+		 *
+		 * @return n_examples
+		 */
+		int get_n_examples() const;
+		/**
+		 * @brief get_nnz number of non-zero entries in the batch
+		 *
+		 * @return nnz
+		 */
+		size_t get_nnz() const;
+};
+
+/**
+ * @brief A column of `dataset::x` in compressed form. Entries are grouped into blocks of `COLUMN_BLOCK_SIZE`,
+ * example ids inside a block are zigzag delta encoded as varints (the first one relative to 0), so any block
+ * can be decoded on its own. As the column is sorted by value, a column with few distinct values only keeps 
+ * the distinct values and the index where each run of them starts, the others keep the raw values.
+ */
+class compressed_column {
+	public:
+		int n; 					/** number of entries */
+		int n_blocks; 			/** number of blocks */
+		unsigned char* id_data; /** varint encoded example id deltas of all the blocks */
+		size_t* block_offset; 	/** offset of each block in `id_data`, size is `n_blocks`+1 */
+		int n_dict; 			/** number of distinct values, 0 if the values are not dictionary encoded */
+		feature_t* dict; 		/** distinct values in ascending order */
+		int* run_start; 		/** entries with value `dict[k]` are [run_start[k], run_start[k+1]), size is `n_dict`+1 */
+		feature_t* value; 		/** raw values if the column is not dictionary encoded */
+
+		/**
+		 * @brief compressed_column constructor
+		 */
+		compressed_column();
+		/**
+		 * @brief ~compressed_column destructor
+		 */
+		~compressed_column();
+		/**
+		 * @brief encode compress a column sorted by value
+		 *
+		 * @param a entries of the column
+		 * @param n number of entries
+		 */
+		void encode(const ev_pair_t* a, int n);
+		/**
+		 * @brief decode_block decompress a block
+		 *
+		 * @param b block index
+		 * @param out output entries, at least `COLUMN_BLOCK_SIZE` long
+		 *
+		 * @return number of entries in the block
+		 */
+		int decode_block(int b, ev_pair_t* out) const;
+		/**
+		 * @brief upper_bound index of the first entry whose value is larger than `v`
+		 *
+		 * @param v feature value
+		 *
+		 * @return entry index, `n` if there is no such entry
+		 */
+		int upper_bound(feature_t v) const;
+		/**
+		 * @brief memory_usage bytes used by the compressed column
+		 *
+		 * @return memory usage
+		 */
+		size_t memory_usage() const;
+};
+
+/**
+ * @brief Columns of a cache file (see `dataset::save_cache`) which are read on demand. A column is read as 
+ * a whole the first time one of its blocks is wanted and kept in a LRU pool whose size is bounded by a memory budget. 
+ * All the member functions are thread safe.
+ */
+class column_pool {
+	private:
+		int fd; 					/** file descriptor of the cache file */
+		int n_features; 			/** number of columns */
+		const int* size; 			/** length of each column */
+		size_t budget; 				/** maximum bytes of the resident columns */
+		size_t used; 				/** bytes of the resident columns */
+		std::vector<long long> offset; 	/** offset of each column in the cache file */
+		std::vector<ev_pair_t*> column; /** resident columns, nullptr if not in memory */
+		std::list<int> lru; 			/** resident features, the most recently used first */
+		std::vector<std::list<int>::iterator> lru_pos; /** position of each resident feature in `lru` */
+		std::mutex mtx; 			/** guards all the members above */
+		long long n_hits; 			/** number of requests served from memory */
+		long long n_misses; 		/** number of columns read from the file */
+
+		/**
+		 * @brief page_in make a column resident and the most recently used, evicting the least recently used 
+		 * columns to stay in budget. A column longer than the budget is still read. Must be called with `mtx` held.
+		 *
+		 * @param f feature id
+		 *
+		 * @return the resident column
+		 */
+		const ev_pair_t* page_in(int f);
+	public:
+		/**
+		 * @brief column_pool constructor
+		 *
+		 * @param fd file descriptor of the cache file, closed by the pool
+		 * @param data_offset offset of the first column in the file
+		 * @param n_features number of columns
+		 * @param size length of each column
+		 * @param budget maximum bytes of the resident columns
+		 */
+		column_pool(int fd, long long data_offset, int n_features, const int* size, size_t budget);
+		/**
+		 * @brief ~column_pool destructor
+		 */
+		~column_pool();
+		/**
+		 * @brief read_block copy the entries [b*COLUMN_BLOCK_SIZE, (b+1)*COLUMN_BLOCK_SIZE) of a column
+		 *
+		 * @param f feature id
+		 * @param b block index
+		 * @param buf output entries, at least `COLUMN_BLOCK_SIZE` long
+		 *
+		 * @return number of entries in the block
+		 */
+		int read_block(int f, int b, ev_pair_t* buf);
+		/**
+		 * @brief upper_bound index of the first entry of a column whose value is larger than `v`
+		 *
+		 * @param f feature id
+		 * @param v feature value
+		 *
+		 * @return entry index
+		 */
+		int upper_bound(int f, feature_t v);
+		/**
+		 * @brief print_stats print hits, misses and resident size of the pool
+		 */
+		void print_stats();
+};
+
 class data_reader {
 	private:
 		int n_features;		/** number of features in the input file */
-		std::ifstream ifs; 		/** input file stream related to the input file */
 		learn_mode mode; 	/** learn mode */
+		data_format format; /** input file format */
+
+		int fd; 			/** file descriptor of the input file */
+		char* buf; 			/** memory mapped content of the input file, or the decompressed content of a compressed file */
+		size_t buf_size; 	/** size of the input file in bytes (bytes decompressed so far for a compressed file) */
+		const char* cur; 	/** current scan position in `buf` */
+		const char* end; 	/** end of `buf` */
+
+		input_compression compression; 	/** compression of the input file */
+		char* src; 						/** memory mapped compressed file, nullptr if the file is not compressed */
+		size_t src_size; 				/** size of the compressed file */
+		size_t capacity; 				/** reserved address space of `buf` for the decompressed content */
+		bool stream_done; 				/** whether the decompression is finished */
+		std::string stream_error; 		/** why the decompression stopped early, empty if it did not */
+		std::atomic<bool> stream_stop; 	/** ask the decompression thread to quit */
+		std::thread decompressor; 		/** thread which decompresses `src` to `buf` */
+		std::mutex stream_mtx; 			/** guards `buf_size`, `stream_done` and `stream_error` of a compressed file */
+		std::condition_variable stream_cv; 	/** notified when more content is decompressed */
+
+		std::vector<size_t> chunk_bound; 	/** the kth chunk is [chunk_bound[k], chunk_bound[k+1]) */
+		bool chunk_complete; 				/** whether `chunk_bound` covers the whole file */
+		std::vector<char> chunk_released; 	/** chunk_released[k] whether the kth chunk has been passed to `release_chunk` */
+		size_t n_released; 					/** chunks [0, n_released) are all released */
+		size_t released; 					/** `buf[0, released)` of a compressed file has been given back to the OS */
+		std::mutex chunk_mtx; 				/** guards `chunk_bound`, `chunk_complete` and the released chunks */
+
+		std::vector<char> keep; 			/** keep[f] whether feature `f` is stored, empty if every feature is stored */
+
+		int n_buckets; 						/** number of buckets the feature ids are hashed to, 0 if the ids are not hashed */
+		std::atomic<int>* bucket_owner; 	/** the raw id first hashed to each bucket, -1 if none and -2 if several */
+		std::atomic<long long> n_merged; 	/** entries added to another entry of the same bucket in the same line */
+
+		std::vector<int> id_buf; 			/** reusable feature id buffer of the current line */
+		std::vector<feature_t> value_buf; 	/** reusable feature value buffer of the current line */
+
+		/**
+		 * @brief parse_int parse a (signed) integer in place without any allocation
+		 *
+		 * @param p begin of the token, moved to the first character after the integer
+		 * @param end end of the buffer
+		 *
+		 * @return integer value
+		 */
+		static int parse_int(const char*& p, const char* end);
+		/**
+		 * @brief parse_float parse a decimal floating point number (with optional exponent) in place without any allocation
+		 *
+		 * @param p begin of the token, moved to the first character after the number, unchanged if the token is not a number
+		 * (e.g. `?`, `NA`, `null` or `nan`, which are missing values)
+		 * @param end end of the buffer
+		 *
+		 * @return floating point value, 0 if the token is not a number
+		 */
+		static double parse_float(const char*& p, const char* end);
+		/**
+		 * @brief parse_line parse one libsvm line starting at `p`, the non-zero entries are appended to `id` and `value`
+		 *
+		 * @param p begin of the line, moved to the begin of the next line
+		 * @param end end of the buffer
+		 * @param y label of the line (untouched in `TEST` mode)
+		 * @param id feature id array to append
+		 * @param value feature value array to append
+		 *
+		 * @return false if the line is blank or a comment
+		 */
+		bool parse_line(const char*& p, const char* end, target_t& y, std::vector<int>& id, std::vector<feature_t>& value);
+		/**
+		 * @brief parse_dense_line parse one comma or tab separated line starting at `p`, the first field is the label
+		 * and the jth field after it is feature `j`-1. Zeros are kept, empty or non-numeric fields are skipped as missing.
+		 *
+		 * @param p begin of the line, moved to the begin of the next line
+		 * @param end end of the buffer
+		 * @param y label of the line (untouched in `TEST` mode)
+		 * @param id feature id array to append
+		 * @param value feature value array to append
+		 *
+		 * @return false if the line is blank or a comment
+		 */
+		bool parse_dense_line(const char*& p, const char* end, target_t& y, std::vector<int>& id, std::vector<feature_t>& value);
+		/**
+		 * @brief hash_feature map a raw feature id to its bucket and record the collision
+		 *
+		 * @param feature_id raw feature id
+		 *
+		 * @return bucket id
+		 */
+		int hash_feature(int feature_id);
+		/**
+		 * @brief merge_collisions add up the entries of a line which are hashed to the same bucket
+		 *
+		 * @param id feature ids, entries before `first` belong to the previous lines
+		 * @param value feature values
+		 * @param first first entry of the line
+		 */
+		void merge_collisions(std::vector<int>& id, std::vector<feature_t>& value, size_t first);
+		/**
+		 * @brief is_dropped whether the value of a feature is not needed (see `set_feature_filter`)
+		 *
+		 * @param feature_id feature id
+		 *
+		 * @return true if the value should be skipped
+		 */
+		bool is_dropped(int feature_id) const;
+		/**
+		 * @brief decompress decompress `src` to `buf` in the background thread, `buf_size` is published after every piece
+		 */
+		void decompress();
+		/**
+		 * @brief publish make the first `size` bytes of `buf` visible to the parsing threads
+		 *
+		 * @param size number of decompressed bytes
+		 * @param done whether the decompression is finished
+		 * @param error why the decompression stopped early, empty if it did not
+		 */
+		void publish(size_t size, bool done, const std::string& error = "");
+		/**
+		 * @brief has_stream_error whether the decompression has stopped early
+		 */
+		bool has_stream_error();
+		/**
+		 * @brief release give `buf[0, pos)` of a compressed file back to the OS (page aligned), it must not be read any more
+		 *
+		 * @param pos offset in `buf`
+		 */
+		void release(size_t pos);
+		/**
+		 * @brief wait_data wait until there is a complete line from `pos` (or the decompression is finished)
+		 *
+		 * @param pos offset in `buf`
+		 *
+		 * @return number of bytes of `buf` which can be read
+		 */
+		size_t wait_data(size_t pos);
+		/**
+		 * @brief read_range parse all the lines in `buf[begin, end)` and append them to `batch`
+		 *
+		 * @param begin begin offset in `buf` (should be the begin of a line)
+		 * @param end end offset in `buf` (should be the begin of a line or the end of file)
+		 * @param batch examples to append
+		 */
+		void read_range(size_t begin, size_t end, example_batch& batch);
 	public:
 		/**
-		 * @brief data_reader constructor
+		 * @brief data_reader constructor, the input file is memory mapped and scanned in place. A gzip, xz or zstd 
+		 * (built with `RF_WITH_ZSTD`) compressed file is detected by the magic bytes and decompressed to memory 
+		 * by a background thread, parsing starts as soon as the first lines are ready.
 		 *
-		 * @param n_features number of features
+		 * @param filename input file name
+		 * @param n_features number of features, non-positive value means feature ids are not checked
 		 * @param mode train or predict
+		 * @param format `LIBSVM` or `DENSE`, a header line of a `DENSE` file is skipped
 		 */
-		data_reader(const std::string& filename, int n_features, const learn_mode mode);
+		data_reader(const std::string& filename, int n_features, const learn_mode mode, const data_format format = LIBSVM);
 		/**
 		 * @brief ~data_reader destructor
 		 */
 		~data_reader();
 		/**
-		 * @brief read_an_example read an example
+		 * @brief set_feature_hash map every raw feature id to one of `n_buckets` buckets by a hash function (hashing trick), 
+		 * entries of a line in the same bucket are added up. `n_features` should be `n_buckets`.
+		 *
+		 * @param n_buckets number of buckets, 0 to keep the raw ids
+		 */
+		void set_feature_hash(int n_buckets);
+		/**
+		 * @brief print_hash_stats print how many buckets are used and shared by several raw ids, and how many entries are merged
+		 */
+		void print_hash_stats();
+		/**
+		 * @brief set_feature_filter only store the given features, e.g. the features used by a model when predicting. 
+		 * The values of the other features are skipped without being converted from text, and feature ids 
+		 * beyond `n_features` are still reported.
 		 *
-		 * @param ifs input file stream to read example
+		 * @param features ids of the features to store
+		 */
+		void set_feature_filter(const std::vector<int>& features);
+		/**
+		 * @brief read_an_example read an example
 		 *
-		 * @return a single example's features
+		 * @return a single example's features, nullptr if reach the end of file
 		 */
 		example_t* read_an_example();		
 		/**
 		 * @brief read_examples read all the example
 		 *
-		 * @param filename 
-		 *
 		 * @return a vector contains all examples' features
 		 */
 		std::vector<example_t*> read_examples();
+		/**
+		 * @brief read_examples read all the examples into a CSR batch, the file is split into chunks
+		 * aligned to line boundaries (see `plan_chunks`) which are parsed by `n_threads` threads, chunks of a 
+		 * compressed file are parsed while the rest is being decompressed.
+		 * Examples keep the same order as they are in the file.
+		 *
+		 * @param batch output examples
+		 * @param n_threads number of threads, non-positive value means all the cores
+		 */
+		void read_examples(example_batch& batch, int n_threads);
+		/**
+		 * @brief plan_chunks prepare the chunks of the unread part of the input file for `n_threads` workers, worker `w` 
+		 * handles chunk `w`, `w`+n, `w`+2n ... (n is the return value). A plain file is split into one chunk per worker, 
+		 * a compressed file is cut into `STREAM_CHUNK_SIZE` chunks while it is being decompressed.
+		 *
+		 * @param n_threads number of workers wanted, non-positive value means one per core
+		 *
+		 * @return number of workers
+		 */
+		int plan_chunks(int n_threads);
+		/**
+		 * @brief set_chunks use the chunks found by a previous reader of the same file
+		 *
+		 * @param bound chunk boundaries returned by `get_chunks`
+		 */
+		void set_chunks(const std::vector<size_t>& bound);
+		/**
+		 * @brief get_chunk get the kth chunk, waiting for it to be decompressed. Thread safe.
+		 *
+		 * @param k chunk index
+		 * @param begin begin offset in the input file
+		 * @param end end offset in the input file
+		 *
+		 * @return false if there are less than `k`+1 chunks
+		 */
+		bool get_chunk(int k, size_t& begin, size_t& end);
+		/**
+		 * @brief get_chunks boundaries of all the chunks, only complete after every chunk has been requested
+		 *
+		 * @return chunk boundaries, the kth chunk is [ret[k], ret[k+1])
+		 */
+		std::vector<size_t> get_chunks();
+		/**
+		 * @brief release_chunk tell the reader the kth chunk is parsed for the last time, the decompressed content 
+		 * of a compressed file before the first chunk which is not released yet is given back to the OS. Thread safe.
+		 *
+		 * @param k chunk index
+		 */
+		void release_chunk(int k);
+		/**
+		 * @brief check_stream report the error of a compressed file which can not be decompressed completely and exit, 
+		 * called by the parsing thread after the workers are joined (`get_chunk` stops handing chunks out after an error)
+		 */
+		void check_stream();
+		/**
+		 * @brief split split the unread part of the input file into at most `n_threads` byte ranges,
+		 * each range begins at the start of a line so it can be parsed independently. A compressed file 
+		 * is decompressed completely first.
+		 *
+		 * @param n_threads number of ranges wanted, non-positive value means one per core
+		 *
+		 * @return range boundaries, the ith range is [ret[i], ret[i+1])
+		 */
+		std::vector<size_t> split(int n_threads);
+		/**
+		 * @brief next_line parse the next non-blank line in the byte range [pos, end) without keeping any per-line object
+		 *
+		 * @param pos current offset in the input file, moved to the begin of the next line
+		 * @param end end offset of the range
+		 * @param y label of the line (untouched in `TEST` mode)
+		 * @param id cleared and filled with feature ids of the line
+		 * @param value cleared and filled with feature values of the line
+		 *
+		 * @return false if there is no more line in the range
+		 */
+		bool next_line(size_t& pos, size_t end, target_t& y, std::vector<int>& id, std::vector<feature_t>& value);
+		/**
+		 * @brief get_file_size size of the input file in bytes
+		 *
+		 * @return file size
+		 */
+		size_t get_file_size();
 };
 
 class dataset {
@@ -101,32 +567,145 @@ class dataset {
 
 		bool is_init; 		/** boolean variable to indicate whether dataset has been initialized */
 		learn_mode mode; 	/** learn mode */
+
+		std::map<int, int> label_map; 	/** labels out of [0, n_classes) in the input file and the classes they are changed to */
+		int hash_buckets; 				/** number of buckets the feature ids are hashed to, 0 if the ids are not hashed */
+
+		char* cache_buf; 	/** memory mapped cache file which `x` points into, nullptr if `x` is loaded from text */
+		size_t cache_size; 	/** size of the mapped cache file */
+
+		unsigned char* bin_data; /** storage of all the `bin` columns */
+
+		std::string meta_filename; 		/** file scanned by `load_data_meta`, empty if there is no scan to reuse */
+		data_format meta_format; 		/** format of the scanned file */
+		std::vector<size_t> meta_bound; /** line aligned chunks of the scan, the kth chunk is [meta_bound[k], meta_bound[k+1]) */
+		std::vector<int> meta_row_count;/** number of examples in each chunk */
+		std::vector<std::vector<int> > meta_fea_count; /** meta_fea_count[w][f] number of non-zero entries of feature `f` in the chunks of worker `w` */
+
+		ev_pair_t* x_data; 	/** storage of all the columns of `x` if they are loaded from text */
+		compressed_column* cx; /** compressed columns, nullptr if `compress` is not called */
+		feature_t* dense_value_data; /** storage of all the `dense_value` columns */
+		column_pool* pool; 	/** columns read on demand from the cache file, nullptr if not out-of-core */
+		std::string spill_path; /** file which backs the columns built by `load_data`, empty to build them in memory */
+		char* spill_buf; 	/** memory mapped `spill_path` */
+		size_t spill_size; 	/** size of the mapped `spill_path` */
+		int* order_data; 	/** storage of all the `order` columns */
+
+		int* row_start; 	/** sparse entries of example `i` are [row_start[i], row_start[i+1]) of `row_feature` and `row_value` */
+		int* row_feature; 	/** feature id of each sparse entry, ascending within an example */
+		feature_t* row_value; /** feature value of each sparse entry */
+
+		/**
+		 * @brief build_dense move every feature which has an entry for each example from `x` to `dense_value` and `order`,
+		 * the remaining sparse columns are packed again so the memory of the dense ones is released
+		 *
+		 * @param n_threads number of threads, non-positive value means all the cores
+		 */
+		void build_dense(int n_threads);
+
+		/**
+		 * @brief release_columns free the storage of the columns (heap, mapped cache file or spill file) and of the 
+		 * dense columns, `x`, `dense_value` and `order` are left dangling and must be set again by the caller
+		 */
+		void release_columns();
+		/**
+		 * @brief make_cache_header fill the cache header of the current column store
+		 *
+		 * @param header output header, `data_offset` is the page aligned end of the meta data
+		 * @param source path of the text file the dataset is loaded from
+		 * @param with_dense whether the dense columns are stored at `dense_offset` (shared segment) instead of as pairs
+		 *
+		 * @return size of the header and the meta data before the padding
+		 */
+		long long make_cache_header(cache_header_t& header, const std::string& source, bool with_dense);
+		/**
+		 * @brief cache_content_size size of a cache image without any padding at its end
+		 *
+		 * @param header cache header
+		 *
+		 * @return end of `x`, or of the `order` columns if the dense columns are stored
+		 */
+		static long long cache_content_size(const cache_header_t& header);
+		/**
+		 * @brief is_cache_of_source whether a cache header is of this version and was built from the current `source`
+		 *
+		 * @param header cache header
+		 * @param source path of the text file the cache is built from
+		 * @param image_size size of the cache file or shared segment
+		 * @param padded whether the image may be longer than its content (a segment rounded up to the page size)
+		 *
+		 * @return true if the cache is up to date, whatever `n_classes` and `n_features` it has
+		 */
+		static bool is_cache_of_source(const cache_header_t& header, const std::string& source, long long image_size, bool padded);
+		/**
+		 * @brief is_cache_current whether a cache header matches this dataset and the current `source`
+		 *
+		 * @param header cache header
+		 * @param source path of the text file the cache is built from
+		 * @param image_size size of the cache file or shared segment
+		 * @param padded whether the image may be longer than its content (a segment rounded up to the page size)
+		 *
+		 * @return true if the cache can be used
+		 */
+		bool is_cache_current(const cache_header_t& header, const std::string& source, long long image_size, bool padded);
+		/**
+		 * @brief read_cache_meta copy `size`, `valid_features`, `is_cate`, `y` and `label_map` from the meta data of a cache
+		 *
+		 * @param header cache header
+		 * @param p begin of the meta data, right after the header
+		 */
+		void read_cache_meta(const cache_header_t& header, const char* p);
+		/**
+		 * @brief point_columns point `x`, and `dense_value` and `order` of the stored dense columns, into `cache_buf`
+		 *
+		 * @param header cache header
+		 */
+		void point_columns(const cache_header_t& header);
+		/**
+		 * @brief open_shared open a shared segment, a name like "/name" is a POSIX shared memory object and 
+		 * any other path is a regular file (e.g. on a hugetlbfs mount for huge pages)
+		 *
+		 * @param name segment name
+		 * @param flags `open` flags
+		 *
+		 * @return file descriptor, negative on error
+		 */
+		static int open_shared(const std::string& name, int flags);
+
+		/**
+		 * @brief build_feature_bins compute quantile cut points of a feature (zeros included) and the bin index of each entry
+		 *
+		 * @param f feature id
+		 * @param max_bins maximum number of bins
+		 */
+		void build_feature_bins(int f, int max_bins);
 		
 		/**
-		 * @brief isort code comes from `fest package` http://lowrank.net/nikos/fest/
+		 * @brief radix_key map a float to an unsigned integer with the same order
 		 *
-		 * @param a example_id-feature_value pair array
-		 * @param f corresponding feature_id in array `a`
-		 * @param n array length
+		 * @param v feature value
+		 *
+		 * @return order preserving key
 		 */
-		void isort(ev_pair_t* a, int* f, int n);
+		static uint32_t radix_key(feature_t v);
 		/**
-		 * @brief qsortlazy code comes from `fest package` http://lowrank.net/nikos/fest/
+		 * @brief sort_column sort a single column by feature value, short columns use insertion sort and 
+		 * the others use LSD radix sort on the float key. Both are stable, so examples with the same value stay in `ex_id` order
 		 *
-		 * @param a example_id-feature_value pair array
-		 * @param f corresponding feature_id in array `a`
-		 * @param l begin index in array
-		 * @param u end index in array
+		 * @param a column to sort
+		 * @param n column length
+		 * @param tmp scratch buffer with at least `n` entries
+		 * @param sort_ties also sort by `ex_id` (as the less significant key) if the column is not in `ex_id` order
 		 */
-		void qsortlazy(ev_pair_t* a, int* f, int l, int u);
+		static void sort_column(ev_pair_t* a, int n, ev_pair_t* tmp, bool sort_ties = false);
 		/**
-		 * @brief sort code comes from `fest package` http://lowrank.net/nikos/fest/
+		 * @brief sort sort every column of `x` by feature value, columns are independent so they are sorted 
+		 * by `n_threads` threads, the longest column first
 		 *
-		 * @param a example_id-feature_value pair array
-		 * @param f corresponding feature_id in array `a`
-		 * @param len array length
+		 * @param n_threads number of threads, non-positive value means all the cores
+		 * @param sort_ties also sort the examples with the same value by `ex_id`, needed if the columns are not filled in `ex_id` order
 		 */
-		void sort(ev_pair_t* a, int* f, int len);
+		void sort(int n_threads, bool sort_ties = false);
 	public:
 		/*==================================================
 		 * 				member variables 
@@ -138,6 +717,15 @@ class dataset {
 		target_t* y; 		/** label for each example */
 		float* weight; 		/** weight for each class */
 		bool* is_cate; 		/** is the ith attribute categorical */
+		bool* is_dense; 	/** is the ith attribute stored in `dense_value` and `order` instead of `x` */
+		feature_t** dense_value;/** dense_value[f][i] is feature `f` of the ith example, nullptr for a sparse feature */
+		int** order; 		/** order[f] is the example ids sorted by `dense_value[f]`, nullptr for a sparse feature */
+		std::vector<int> labels;/** distinct labels in the input file (ascending) found by `load_data_meta` */
+
+		unsigned char** bin;/** bin[f][j] is the bin index of x[f][j], nullptr if the dataset is not binned */
+		feature_t** cut; 	/** cut[f][b] is the largest value in bin `b` of feature `f` (`n_bins[f]`-1 cut points, ascending) */
+		int* n_bins; 		/** number of bins of each feature */
+		int* zero_bin; 		/** the bin which value 0 falls in for each feature */
 
 		/*==================================================
 		 * 				member functions 
@@ -166,19 +754,231 @@ class dataset {
 		 * @param weight weight for each class
 		 */
 		void init(int n_classes, int n_features, float* weight);
+		/**
+		 * @brief set_feature_hash hash the feature ids of the following `load_data` and `load_data_meta` into `n_buckets` buckets, 
+		 * so `n_features` (given to `init`) is `n_buckets` however large the raw id space is. See `data_reader::set_feature_hash`.
+		 *
+		 * @param n_buckets number of buckets, 0 to keep the raw ids
+		 */
+		void set_feature_hash(int n_buckets);
+		/**
+		 * @brief get_feature_hash number of buckets the feature ids are hashed to
+		 *
+		 * @return number of buckets, 0 if the ids are not hashed
+		 */
+		int get_feature_hash();
 		/**
 		 * @brief load_data generate the dataset from input file
 		 *
 		 * @param filename input file name
 		 * @param mode `TRAIN` or `TEST`
+		 * @param n_threads number of threads to parse the input file, non-positive value means all the cores
+		 * @param format `LIBSVM` or `DENSE`, features without any missing value are stored as dense columns in either format
+		 */
+		void load_data(const std::string& filename, const learn_mode mode, int n_threads = DEFAULT_N_THREADS, const data_format format = LIBSVM);
+		/**
+		 * @brief append add labeled examples to a loaded training set, the new entries of each column are sorted and merged
+		 * into the sorted column, so every column costs O(existing + new) instead of a full resort. Features are merged by 
+		 * `n_threads` threads. The new examples get ids from `n_examples` on, in their order in `examples`; `y`, `size` 
+		 * and `valid_features` are updated and dense columns are detected again. Labels are changed the same way as 
+		 * `load_data` did. It must be called before `compress` and `build_bins`, and not on an out-of-core dataset.
+		 *
+		 * @param examples new examples in CSR format
+		 * @param n_threads number of threads, non-positive value means all the cores
+		 */
+		void append(example_batch& examples, int n_threads = DEFAULT_N_THREADS);
+		/**
+		 * @brief append add labeled examples to a loaded training set
+		 *
+		 * @param examples new examples
+		 * @param n_threads number of threads, non-positive value means all the cores
+		 */
+		void append(std::vector<example_t*>& examples, int n_threads = DEFAULT_N_THREADS);
+		/**
+		 * @brief build_bins quantize each feature into at most `max_bins` bins by quantile cut points, which is needed by `HISTOGRAM_SPLIT`
+		 *
+		 * @param max_bins maximum number of bins of a feature (2 ~ 256)
+		 * @param n_threads number of threads, non-positive value means all the cores
+		 */
+		void build_bins(int max_bins, int n_threads = DEFAULT_N_THREADS);
+		/**
+		 * @brief is_binned whether `build_bins` has been called
+		 *
+		 * @return true if the dataset is binned
+		 */
+		bool is_binned();
+		/**
+		 * @brief build_rows build a row major copy of the sparse columns, so the value of a feature of one example 
+		 * can be found by `lookup` in O(log(non-zero features of the example)). It is skipped for a compressed or 
+		 * out-of-core dataset, which should not hold a second copy of the entries. The rows are dropped by `append`.
+		 * They take 8 bytes per sparse entry plus 4 bytes per example in private memory, even if the columns are 
+		 * mapped from a cache file or a shared segment, so they are only built on request (`rows` under `Train`).
+		 */
+		void build_rows();
+		/**
+		 * @brief has_rows whether `build_rows` has built the rows
+		 *
+		 * @return true if `lookup` can be used
+		 */
+		bool has_rows();
+		/**
+		 * @brief lookup value of a feature of an example (needs `build_rows` unless the feature is dense)
+		 *
+		 * @param ex_id example id
+		 * @param f feature id
+		 * @param v output feature value
+		 *
+		 * @return false if the example has no entry of the feature (its value is 0)
+		 */
+		bool lookup(int ex_id, int f, feature_t& v);
+		/**
+		 * @brief get_avg_row_size average number of sparse entries of an example
+		 *
+		 * @return average row length
+		 */
+		double get_avg_row_size();
+		/**
+		 * @brief set_categorical mark exactly these features as categorical, their values must be integer category ids in [0, `MAX_CATEGORIES`) 
+		 * (a missing entry is category 0).
+		 *
+		 * @param features ids of the categorical features
+		 */
+		void set_categorical(const std::vector<int>& features);
+		/**
+		 * @brief set_spill_file build the columns of the following `load_data` in a file backed mapping instead of the heap,
+		 * so the OS can write them back to disk when they do not fit in memory. The file is removed by the destructor.
+		 * Dense columns are not separated in this mode.
+		 *
+		 * @param path path of the backing file
+		 */
+		void set_spill_file(const std::string& path);
+		/**
+		 * @brief compress replace the columns of `x` by `compressed_column`, which are decoded block by block
+		 * with `get_block` during training. `x` is released and all its pointers are set to nullptr. The dense columns 
+		 * of a loaded cache file or an attached shared segment are copied to memory before it is unmapped.
+		 *
+		 * @param n_threads number of threads, non-positive value means all the cores
+		 */
+		void compress(int n_threads = DEFAULT_N_THREADS);
+		/**
+		 * @brief is_out_of_core whether the columns are read on demand from a cache file
+		 *
+		 * @return true if `load_cache` is called with a memory budget
+		 */
+		bool is_out_of_core();
+		/**
+		 * @brief print_pool_stats print the statistics of the column pool of an out-of-core dataset
+		 */
+		void print_pool_stats();
+		/**
+		 * @brief is_compressed whether `compress` has been called
+		 *
+		 * @return true if the columns are compressed
+		 */
+		bool is_compressed();
+		/**
+		 * @brief get_n_blocks number of blocks of a column, each block has `COLUMN_BLOCK_SIZE` entries except the last one
+		 *
+		 * @param f feature id
+		 *
+		 * @return number of blocks
+		 */
+		int get_n_blocks(int f);
+		/**
+		 * @brief get_block get the entries [b*COLUMN_BLOCK_SIZE, (b+1)*COLUMN_BLOCK_SIZE) of a column, it points into `x` 
+		 * directly if the column is sparse and not compressed, otherwise the block is decoded (or gathered from a dense column) into `buf`
+		 *
+		 * @param f feature id
+		 * @param b block index
+		 * @param buf buffer of at least `COLUMN_BLOCK_SIZE` entries
+		 * @param n number of entries in the block
+		 *
+		 * @return entries of the block
+		 */
+		const ev_pair_t* get_block(int f, int b, ev_pair_t* buf, int& n);
+		/**
+		 * @brief upper_bound index of the first entry of a column whose value is larger than `v`
+		 *
+		 * @param f feature id
+		 * @param v feature value
+		 *
+		 * @return entry index, `size[f]` if there is no such entry
+		 */
+		int upper_bound(int f, feature_t v);
+		/**
+		 * @brief save_cache save the column store to a binary cache file which can be mapped by `load_cache` later,
+		 * it must be called before `compress`
+		 *
+		 * @param cache_path path of the cache file
+		 * @param source path of the text file the dataset is loaded from, its size and modify time are recorded
+		 */
+		void save_cache(const std::string& cache_path, const std::string& source);
+		/**
+		 * @brief load_cache map a cache file saved by `save_cache`, `x` points into the mapped file so nothing needs to be parsed or sorted
+		 *
+		 * @param cache_path path of the cache file
+		 * @param source path of the text file the cache is built from
+		 * @param memory_budget if positive, the columns are not mapped but read on demand into a `column_pool` of at most 
+		 * `memory_budget` bytes (out-of-core mode), `x` is all nullptr and columns must be read through `get_block`
+		 *
+		 * @param n_threads number of threads to build the dense columns of a mapped cache, non-positive value means all the cores
+		 *
+		 * @return false if the cache file does not exist, or it is out of date (version, `n_classes`, `n_features`,
+		 * size or modify time of `source` do not match), then the caller should `load_data` and `save_cache` again
+		 */
+		bool load_cache(const std::string& cache_path, const std::string& source, size_t memory_budget = 0, int n_threads = DEFAULT_N_THREADS);
+		/**
+		 * @brief read_cache_counts read `n_classes` and `n_features` from the header of a cache file or a complete 
+		 * shared segment, so they need not be found out by `load_data_meta` before the cache is loaded
+		 *
+		 * @param path cache file path, or segment name if `shared`
+		 * @param shared whether `path` is a segment published by `publish_shared`
+		 * @param source path of the text file the cache is built from
+		 * @param n_classes output number of classes
+		 * @param n_features output number of features
+		 *
+		 * @return false if there is no cache which is up to date with `source`
 		 */
-		void load_data(const std::string& filename, const learn_mode mode);
+		static bool read_cache_counts(const std::string& path, bool shared, const std::string& source, int& n_classes, int& n_features);
 		/**
-		 * @brief load_data_meta 
+		 * @brief publish_shared copy the column store (in the layout of `save_cache`, but with the dense columns as 
+		 * `dense_value` and `order` arrays) to a shared segment which other processes can `attach_shared` read-only, 
+		 * then use the segment instead of the private columns, so all the processes share one physical copy. The segment is complete once its magic is written, which is done last. 
+		 * It is kept after the process exits until `remove_shared`. It must be called before `compress`.
+		 *
+		 * @param name POSIX shared memory name ("/name") or a file path (e.g. on a hugetlbfs mount)
+		 * @param source path of the text file the dataset is loaded from, its size and modify time are recorded
 		 *
-		 * @param filename
+		 * @return false if the segment already exists (another process published it or is publishing it)
+		 */
+		bool publish_shared(const std::string& name, const std::string& source);
+		/**
+		 * @brief attach_shared map a segment published by `publish_shared` read-only, `x`, `dense_value` and `order` 
+		 * point into it so nothing needs to be parsed, sorted or copied. A complete segment which is out of date is removed, so it can be published again.
+		 *
+		 * @param name POSIX shared memory name ("/name") or a file path
+		 * @param source path of the text file the segment is built from
+		 *
+		 * @return false if the segment does not exist, is not complete yet or is out of date
+		 */
+		bool attach_shared(const std::string& name, const std::string& source);
+		/**
+		 * @brief remove_shared remove a published segment, the processes which attached it keep their mapping
+		 *
+		 * @param name POSIX shared memory name ("/name") or a file path
+		 */
+		static void remove_shared(const std::string& name);
+		/**
+		 * @brief load_data_meta scan a libsvm file in parallel for the number of examples, the largest feature id, 
+		 * the distinct labels and the number of non-zero entries of each feature. If the dataset is not initialized yet, 
+		 * `n_features` and `n_classes` are set from the file so they can be passed to `init`, otherwise the file is checked 
+		 * against them. A following `load_data` of the same file reuses the counts and only parses the file once more.
+		 *
+		 * @param filename input file name
+		 * @param n_threads number of threads, non-positive value means all the cores
+		 * @param format `LIBSVM` or `DENSE`
 		 */
-		void load_data_meta(const std::string& filename);
+		void load_data_meta(const std::string& filename, int n_threads = DEFAULT_N_THREADS, const data_format format = LIBSVM);
 		/**
 		 * @brief debug print some information for debugging
 		 */
@@ -21,6 +21,7 @@
 #include "tree.h"
 #include "dataset.h"
 #include "parallel.h"
+#include "scheduler.h"
 
 /* declaration */
 class forest;
@@ -34,11 +35,14 @@ class forest {
 		int n_threads;
 		int n_classes;
 		int n_features;
+		int hash_buckets;
 		std::string feature_rule;
 
 		int max_feature;
 		int max_depth;
 		int min_split;
+		split_mode split;
+		grow_mode grow;
 
 		int verbose;
 
@@ -49,30 +53,34 @@ class forest {
 		bool check_build();
 
 		void free_forest();
-		void parallel_predict_proba(int tree_begin, int tree_end, std::vector<example_t*> &examples, float* ret);
-		void parallel_apply(int tree_begin, int tree_end, std::vector<example_t*> &examples, int* ret);
+		void parallel_predict_proba(int tree_begin, int tree_end, example_batch &examples, float* ret);
+		void parallel_apply(int tree_begin, int tree_end, example_batch &examples, int* ret);
 	public:
 		forest();
-		forest(const std::string feature_rule, int max_depth, int min_split, int n_trees, int n_threads, int verbose = 1);
+		forest(const std::string feature_rule, int max_depth, int min_split, int n_trees, int n_threads, int verbose = 1, split_mode split = BEST_SPLIT, grow_mode grow = DEPTH_FIRST);
 		virtual ~forest();
 		float* compute_importance(bool re_compute = false);
 		int* apply(std::vector<example_t*> &examples);
+		int* apply(example_batch &examples);
 		float* predict_proba(std::vector<example_t*> &examples);
+		float* predict_proba(example_batch &examples);
 		int* predict_label(std::vector<example_t*> &examples);
 		void export_dotfile(const std::string& filename, dotfile_mode dm = SEPARATE_TREES);
 		int* get_leaf_counts();
+		std::vector<int> get_used_features();
 		int get_max_feature();
 		int get_n_features();
 		int get_n_classes();
+		int get_feature_hash();
 		virtual void dump(const std::string& filename) const = 0;
 		virtual void load(const std::string& filename) = 0;
 };
 
 class random_forest_classifier : public forest {
 	private:
-		void parallel_build(int tree_begin, int tree_end, dataset*& d);
+		void parallel_build(int tree_begin, int tree_end, dataset*& d, int split_threads, task_scheduler* sched = nullptr, split_workspace** workspace = nullptr);
 	public:
-		random_forest_classifier(const std::string feature_rule, int max_depth, int min_split, int n_trees, int n_threads, int verbose = 1);
+		random_forest_classifier(const std::string feature_rule, int max_depth, int min_split, int n_trees, int n_threads, int verbose = 1, split_mode split = BEST_SPLIT, grow_mode grow = DEPTH_FIRST);
 		random_forest_classifier();
 		~random_forest_classifier();
 
@@ -0,0 +1,90 @@
+/**
+ * @file scheduler.h
+ * @brief work-stealing task scheduler shared by the forest and the trees it builds
+ * @version 1.0
+ * @date 2026-10-18
+ */
+#pragma once
+
+/* C++ header file */
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+/**
+ * @brief Each worker thread has a deque of tasks. A worker runs its own newest task first (so a task and the tasks
+ * it spawns run depth-first, as a recursion would), and an idle worker steals the oldest task of another worker
+ * (the biggest piece of work left). A task may spawn tasks and `wait` for them, the waiting thread runs other
+ * tasks meanwhile.
+ */
+class task_scheduler {
+	private:
+		typedef struct {
+			std::deque<std::function<void()> > tasks; 	/** pushed and popped at the back by the owner, stolen at the front */
+			std::mutex lock; 		/** guards `tasks` */
+		} worker_t;
+
+		std::vector<worker_t*> workers; 	/** workers[0] is the thread which creates the scheduler */
+		std::vector<std::thread> threads; 	/** the other workers */
+		std::atomic<int> n_queued; 			/** tasks in all the deques */
+		std::mutex idle_lock; 				/** guards `stop`, idle workers sleep on `idle` */
+		std::condition_variable idle;
+		std::condition_variable done; 		/** waiting workers sleep on it until a task returns or is queued */
+		bool stop;
+
+		/**
+		 * @brief run_one run the newest task of worker `w`, or steal the oldest task of another worker
+		 *
+		 * @param w worker id
+		 *
+		 * @return false if there is no task at all
+		 */
+		bool run_one(int w);
+		/**
+		 * @brief work loop of worker `w` (`w` > 0), sleeps while there is no task
+		 *
+		 * @param w worker id
+		 */
+		void work(int w);
+	public:
+		/**
+		 * @brief Constructor, start `n_threads`-1 worker threads, the calling thread is worker 0
+		 *
+		 * @param n_threads number of workers, the hardware concurrency if not positive
+		 */
+		task_scheduler(int n_threads);
+		/**
+		 * @brief Destructor, stop and join the workers (every task should have been waited for)
+		 */
+		~task_scheduler();
+		/**
+		 * @brief get_n_workers get the number of workers
+		 *
+		 * @return number of workers, including the creating thread
+		 */
+		int get_n_workers();
+		/**
+		 * @brief current_worker id of the calling thread
+		 *
+		 * @return worker id, 0 for a thread which is not a worker of this scheduler
+		 */
+		int current_worker();
+		/**
+		 * @brief spawn queue `task` on the deque of the calling worker, `pending` is increased now and decreased
+		 * when `task` returns
+		 *
+		 * @param task task to run
+		 * @param pending counter of the unfinished tasks of the caller
+		 */
+		void spawn(std::function<void()> task, std::atomic<int>& pending);
+		/**
+		 * @brief wait run tasks until `pending` drops to 0, sleep while there is no task to run
+		 *
+		 * @param pending counter given to `spawn`
+		 */
+		void wait(std::atomic<int>& pending);
+};
@@ -19,10 +19,16 @@
 #include <vector>
 #include <stack>
 #include <iomanip>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <atomic>
 /* my header file */
 #include "dataset.h"
 #include "utils.h"
 #include "random.h"
+#include "parallel.h"
+#include "scheduler.h"
 
 /* declaration */
 class node;
@@ -33,10 +39,27 @@ class decision_tree;
 class online_tree;
 class splitter;
 class best_splitter;
+class hist_splitter;
 class random_splitter;
 class criterion;
 class gini;
+class split_workspace;
 
+/** class histograms of a node, keyed by feature id, each one is `n_bins[f]`*`n_classes` weighted frequencies */
+typedef std::unordered_map<int, std::vector<float> > hist_cache_t;
+
+/** 
+ * @brief A node waiting to be split when the tree is grown level-wise (see `LEVEL_WISE`)
+ */
+typedef struct {
+	node* nd; 			/** the tree node */
+	int begin; 			/** first entry of the examples of the node in `sample` */
+	int end; 			/** one past the last entry of the examples of the node in `sample` */
+	best_splitter* s; 	/** best split found so far */
+	criterion* cr; 		/** criterion of the node */
+	int* candidate; 	/** candidate features of the node (owned by `s`) */
+	int n_candidates; 	/** number of candidate features */
+}level_node_t;
 
 /**
  * @brief An abstract class for node in the tree
@@ -45,7 +68,9 @@ class node {
 	public:
 		bool is_cate; /** is the split feature categorical */
 		int feature_id; /** split feature id */
-		feature_t threshold; /** for categorical attribute is the chosen feature value for left child node, for continous attribute is the threshold to determine left or right */
+		feature_t threshold; /** for continous attribute is the threshold to determine left or right (unused for categorical attribute) */
+		int n_cate_words; 	/** length of `cate_set` */
+		unsigned int* cate_set; /** for categorical attribute, bit `k` is set if category `k` goes to the left child, nullptr otherwise */
 		float gain; /** heuristic measure(e.g. gini index or information gain) */
 
 		int n_classes; /** number of different class in the node */
@@ -94,6 +119,28 @@ class node {
 		 */
 		void load(std::ifstream& ifs);
 		void print_info();
+		/**
+		 * @brief go_left whether an example goes to the left child, a categorical split tests the category set, 
+		 * a continuous split compares with `threshold`
+		 *
+		 * @param v value of the split feature of the example
+		 *
+		 * @return true if it goes left
+		 */
+		bool go_left(feature_t v) const;
+		/**
+		 * @brief zero_left whether the examples without an entry of the split feature go to the left child, `go_left(0)`
+		 *
+		 * @return true if they went left
+		 */
+		bool zero_left() const;
+		/**
+		 * @brief set_categories make this node a categorical split
+		 *
+		 * @param cate_set bit `k` is set if category `k` goes left
+		 * @param n_cate_words length of `cate_set`
+		 */
+		void set_categories(const unsigned int* cate_set, int n_cate_words);
 };
 
 /**
@@ -128,6 +175,12 @@ class tree {
 		int max_feature; 	/** number of feature to consider when split */
 		int max_depth; 		/** the maximum depth to grow */
 		int min_split; 		/** the minimum examples needed to split */
+		split_mode split; 	/** how to choose the split thresholds */
+		grow_mode grow; 	/** grow node by node (`DEPTH_FIRST`) or a whole depth at a time (`LEVEL_WISE`) */
+		int n_threads; 		/** tasks searching the split of a large node, see `best_splitter::split` */
+		task_scheduler* sched; 	/** the large subtrees and splits are run as tasks of this scheduler, nullptr to build by the calling thread alone */
+		split_workspace** workspace; 	/** workspace[w] is used by worker `w` of `sched` (workspace[0] alone without a scheduler), nullptr to make them in `build` */
+		std::mutex leaf_lock; 	/** guards `leaf_pt`, the leaves of the subtrees built as tasks are attached concurrently */
 
 		float* fea_imp; 	/** feature importance */
 		int verbose; 		/** the debug information level, 0 is nothing, default 1 */
@@ -145,7 +198,9 @@ class tree {
 		 */
 		void check_build();
 	public:
-		int* valid; 		/** is the example valid to consider when split */
+		int* sample; 		/** examples of the tree, partitioned in place so each node being split owns a range of it (see `splitter::node_begin`) */
+		std::atomic<int>* in_node; 	/** in_node[i] is the stamp of the node (or the side of a partition) of example `i` */
+		std::atomic<int> node_stamp; 	/** the last stamp given, each node (and each partition) gets a new one, so the stamps are unique within the tree */
 
 		/**
 		 * @brief Non-parameter constructor (need to call `init` function maually if using this constructor
@@ -166,8 +221,12 @@ class tree {
 		 * If the value is invalid, the program will take `sqrt` as default other than just exit.
 		 * @param max_depth the depth limitation of tree 
 		 * @param min_split the minimum number of examples needed to make a split in a node
+		 * @param split `BEST_SPLIT` tests every threshold, `HISTOGRAM_SPLIT` tests bin boundaries of a binned dataset, 
+		 * `RANDOM_SPLIT` tests one random threshold per candidate feature
+		 * @param grow `DEPTH_FIRST` builds node by node, `LEVEL_WISE` splits all the nodes of a depth with one pass over each column
+		 * @param n_threads tasks searching the split of a node with at least `PARALLEL_SPLIT_MIN_EXAMPLES` examples (depth-first `BEST_SPLIT` only), and workers of the scheduler a tree built alone makes
 		 */
-		tree(const std::string feature_rule, int max_depth, int min_split, int verbose = 1);
+		tree(const std::string feature_rule, int max_depth, int min_split, int verbose = 1, split_mode split = BEST_SPLIT, grow_mode grow = DEPTH_FIRST, int n_threads = 1);
 		/**
 		 * @brief Initialize the tree(e.g. set some parameter and allocate memory to some variables)
 		 *
@@ -180,8 +239,12 @@ class tree {
 		 * @param max_depth the depth limitation of tree 
 		 * @param min_split the minimum number of examples needed to make a split in a node
 		 * @param verbose print log level
+		 * @param split `BEST_SPLIT` tests every threshold, `HISTOGRAM_SPLIT` tests bin boundaries of a binned dataset, 
+		 * `RANDOM_SPLIT` tests one random threshold per candidate feature
+		 * @param grow `DEPTH_FIRST` builds node by node, `LEVEL_WISE` splits all the nodes of a depth with one pass over each column
+		 * @param n_threads tasks searching the split of a node with at least `PARALLEL_SPLIT_MIN_EXAMPLES` examples (depth-first `BEST_SPLIT` only), and workers of the scheduler a tree built alone makes
 		 */
-		void init(const std::string feature_rule, int max_depth, int min_split, int verbose);
+		void init(const std::string feature_rule, int max_depth, int min_split, int verbose, split_mode split = BEST_SPLIT, grow_mode grow = DEPTH_FIRST, int n_threads = 1);
 		/**
 		 * @brief Compute feature importance after building the tree (should call build first)
 		 *
@@ -200,6 +263,14 @@ class tree {
 		 * @return a vector denotes leaf index in `leaf_pt`
 		 */
 		int* apply(std::vector<example_t*> &examples);
+		/**
+		 * @brief apply put examples to its corresponding leaves
+		 *
+		 * @param examples input examples in CSR format
+		 *
+		 * @return a vector denotes leaf index in `leaf_pt`
+		 */
+		int* apply(example_batch &examples);
 		/**
 		 * @brief predict_proba predict the probabilities of belonging to each class (i.e. choose the class with largest frequency as label)
 		 *
@@ -209,6 +280,14 @@ class tree {
 		 * @return N*K vector, N denotes the size of the examples and K is the number of different classes, first N mean the probability exmaples belongs #1 class. 
 		 */
 		float* predict_proba(std::vector<example_t*> &examples);
+		/**
+		 * @brief predict_proba predict the probabilities of belonging to each class
+		 *
+		 * @param examples input examples in CSR format
+		 *
+		 * @return N*K vector, same layout as the `std::vector` version
+		 */
+		float* predict_proba(example_batch &examples);
 		/**
 		 * @brief predict_label predict the label 
 		 *
@@ -218,6 +297,20 @@ class tree {
 		 * @return N dimensional vector, each one is the predicted label
 		 */
 		int* predict_label(std::vector<example_t*> &examples);
+		/**
+		 * @brief predict_label predict the label
+		 *
+		 * @param examples input examples in CSR format
+		 *
+		 * @return N dimensional vector, each one is the predicted label
+		 */
+		int* predict_label(example_batch &examples);
+		/**
+		 * @brief mark_used_features mark the features which are used by any split of the tree
+		 *
+		 * @param used size `n_features`, `used[f]` is set to true if feature `f` is used (others are untouched)
+		 */
+		void mark_used_features(bool* used);
 		/**
 		 * @brief Free memory space of the tree which use `root` as root node (only the tree structure)
 		 *
@@ -251,6 +344,49 @@ class tree {
 		 * @return n_features
 		 */
 		int get_n_features();
+		/**
+		 * @brief get_n_threads get the number of tasks searching the split of a large node
+		 *
+		 * @return number of tasks
+		 */
+		int get_n_threads();
+		/**
+		 * @brief get_scheduler get the scheduler the tree is built with
+		 *
+		 * @return scheduler, nullptr if the tree is built by the calling thread alone
+		 */
+		task_scheduler* get_scheduler();
+		/**
+		 * @brief set_scheduler build the subtrees with at least `TASK_MIN_EXAMPLES` examples as tasks of `sched` 
+		 * (depth-first growth without `HISTOGRAM_SPLIT`), and search the split of a large node by `n_threads` tasks, 
+		 * the other workers steal them. A depth-first tree with more than one thread and no scheduler makes its own.
+		 *
+		 * @param sched scheduler shared with the caller, nullptr to build by the calling thread alone
+		 */
+		void set_scheduler(task_scheduler* sched);
+		/**
+		 * @brief set_workspace reuse the given workspaces (made for the same `split_mode` and number of classes) 
+		 * rather than making new ones for the build, so they are shared by the trees of a forest
+		 *
+		 * @param workspace one workspace per worker of the scheduler (see `set_scheduler`), or one without a scheduler
+		 */
+		void set_workspace(split_workspace** workspace);
+		/**
+		 * @brief stamp_of the stamp of example `ex` in `in_node`. The tasks building other subtrees may restamp 
+		 * their own examples at the same time, which never gives the stamp of this node
+		 *
+		 * @param ex example id
+		 *
+		 * @return stamp
+		 */
+		int stamp_of(int ex) const;
+		/**
+		 * @brief set_stamp stamp example `ex` in `in_node`
+		 *
+		 * @param ex example id, it should belong to the node of the caller
+		 * @param stamp new stamp
+		 */
+		void set_stamp(int ex, int stamp);
 		/**
 		 * @brief get_leaf_size Return private member `leaf_size` value
 		 *
@@ -282,14 +418,101 @@ class tree {
  */
 class decision_tree : public tree {
 	private:
+		std::vector<hist_cache_t> hist_stack; 	/** hist_stack[k] is the histograms of the latest node at depth k (only for `HISTOGRAM_SPLIT`) */
+
 		/**
 		 * @brief Recursively build tree (choose the split and build left and right node)
 		 *
 		 * @param root root node to build
 		 * @param d input dataset
+		 * @param begin first entry of the examples of `root` in `sample`
+		 * @param end one past the last entry of the examples of `root` in `sample`
 		 * @param depth current depth in the whole tree
+		 * @param is_second whether `root` is built after its sibling, then its histograms can be derived from its parent and sibling
+		 */
+		void build_rec(node*& root, dataset*& d, int begin, int end, int depth, bool is_second = false);
+		/**
+		 * @brief build_children build the two children of a split node, the one with the zeros first. If the second one 
+		 * has at least `TASK_MIN_EXAMPLES` examples it is spawned as a task, which an idle worker may steal
+		 *
+		 * @param d input dataset
+		 * @param first child built first
+		 * @param first_begin first entry of the examples of `first` in `sample`
+		 * @param first_end one past the last entry of the examples of `first` in `sample`
+		 * @param second child built second
+		 * @param second_begin first entry of the examples of `second` in `sample`
+		 * @param second_end one past the last entry of the examples of `second` in `sample`
+		 * @param depth depth of the children
+		 */
+		void build_children(dataset*& d, node*& first, int first_begin, int first_end, node*& second, int second_begin, int second_end, int depth);
+		/**
+		 * @brief Build tree a depth at a time, the examples of each node being split are sample[begin, end) of its `level_node_t`
+		 *
+		 * @param d input dataset
+		 */
+		void build_level(dataset*& d);
+		/**
+		 * @brief split_level choose the splits of all the nodes of a level. Each candidate feature of any node is read 
+		 * with one pass over its column, which hands every entry to the node of its example.
+		 *
+		 * @param d input dataset
+		 * @param level nodes to split
+		 * @param node_of node_of[i] is the index in `level` of the node of example `i`, -1 if it is in a leaf
+		 * @param view buffer of n_examples entries, node `k` collects its entries of a column in view[begin, end)
+		 * @param hist histograms of the nodes testing a feature, grown as needed and kept for the next levels
 		 */
-		void build_rec(node*& root, dataset*& d, int depth);
+		void split_level(dataset*& d, std::vector<level_node_t>& level, const int* node_of, ev_pair_t* view, std::vector<float>& hist);
+		/**
+		 * @brief partition_level reorder sample[begin, end) of each split node of a level so the examples going 
+		 * to the left child come first, with one pass over the column of each split feature
+		 *
+		 * @param d input dataset
+		 * @param level nodes which have been split
+		 * @param node_of node_of[i] is the index in `level` of the node of example `i`, -1 if it is in a leaf
+		 * @param mid output, end of the left child of each node in `sample`
+		 */
+		void partition_level(dataset*& d, std::vector<level_node_t>& level, const int* node_of, std::vector<int>& mid);
+		/**
+		 * @brief make_leaf normalize the class frequency of a node and attach it to `leaf_pt`
+		 *
+		 * @param nd node which is not split
+		 */
+		void make_leaf(node* nd);
+		/**
+		 * @brief print_split print the split of the node being split (for `verbose` >= 2), kept out of `build_rec` to save stack in deep trees
+		 *
+		 * @param d input dataset
+		 * @param s splitter which made the split (and knows the examples of the node)
+		 * @param depth depth of the node
+		 * @param tot_ex number of examples in the node
+		 */
+		void print_split(dataset*& d, splitter* s, int depth, int tot_ex);
+		/**
+		 * @brief enter_node make sample[begin, end) the node being split by `s` and stamp its examples in `in_node`, O(end-begin)
+		 *
+		 * @param s splitter of the node
+		 * @param begin first entry in `sample`
+		 * @param end one past the last entry in `sample`
+		 */
+		void enter_node(splitter* s, int begin, int end);
+		/**
+		 * @brief partition reorder the examples of the node being split so the ones going to the left child come first. 
+		 * An example goes left if `node::go_left` of its value is true, an example without an entry follows `node::zero_left`, 
+		 * which is `go_left(0)`: left if `threshold` >= 0, or if category 0 is in the set of a categorical split. 
+		 * The value of each example is looked up in its row (or dense column), or the examples of the column entries on the 
+		 * other side of the zeros are stamped, whichever is cheaper, so the cost does not depend on `n_examples`.
+		 *
+		 * A categorical split sends the examples of the categories in its set to the left.
+		 *
+		 * Only the examples of the node are restamped, so the tasks building other subtrees are not disturbed.
+		 *
+		 * @param d input dataset
+		 * @param nd the node which has been split
+		 * @param s splitter of the node
+		 *
+		 * @return end of the left child in `sample`
+		 */
+		int partition(dataset*& d, node* nd, splitter* s);
 	public:
 		/**
 		 * @brief Constructor
@@ -303,8 +526,12 @@ class decision_tree : public tree {
 		 * @param max_depth the depth limitation of tree 
 		 * @param min_split the minimum number of examples needed to make a split in a node
 		 * @param verbose the debug information level
+		 * @param split `BEST_SPLIT` tests every threshold, `HISTOGRAM_SPLIT` tests bin boundaries of a binned dataset, 
+		 * `RANDOM_SPLIT` tests one random threshold per candidate feature
+		 * @param grow `DEPTH_FIRST` builds node by node, `LEVEL_WISE` splits all the nodes of a depth with one pass over each column
+		 * @param n_threads tasks searching the split of a node with at least `PARALLEL_SPLIT_MIN_EXAMPLES` examples (depth-first `BEST_SPLIT` only), and workers of the scheduler a tree built alone makes
 		 */
-		decision_tree(const std::string feature_rule, int max_depth, int min_split, int verbose);
+		decision_tree(const std::string feature_rule, int max_depth, int min_split, int verbose, split_mode split = BEST_SPLIT, grow_mode grow = DEPTH_FIRST, int n_threads = 1);
 		/**
 		 * @brief decision_tree Default constructor
 		 */
@@ -347,10 +574,41 @@ class online_tree : public tree {
 };
 
 /**
- * @brief Abstract class which is used to split the node 
+ * @brief Abstract class which is used to split the node. A splitter may be reused for many nodes (see `reset`), 
+ * its scratch buffers are kept from one node to the next so the split search does not allocate once they have grown
  */
 class splitter {
+	private:
+		ev_pair_t* block_buf; 		/** a decoded column block */
+		int block_size; 			/** length of `block_buf` */
+		ev_pair_t* view_buf; 		/** entries of a column in the node */
+		int view_size; 				/** length of `view_buf` */
+		int* candidate; 			/** candidate features of the node */
+		int candidate_size; 		/** length of `candidate` */
+
+		/**
+		 * @brief reserve make `buf` at least `n` long, its content is not kept
+		 *
+		 * @param buf buffer
+		 * @param size length of `buf`
+		 * @param n length needed
+		 *
+		 * @return `buf`
+		 */
+		static ev_pair_t* reserve(ev_pair_t*& buf, int& size, int n);
+		static int* reserve(int*& buf, int& size, int n);
 	protected:
+		float* tmp_left; 			/** scratch of `n_classes`, left frequency of the thresholds being tested */
+		float* tmp_right; 			/** scratch of `n_classes`, right frequency of the threshold being tested */
+		float* tmp_zero; 			/** scratch of `n_classes`, frequency of the examples without an entry */
+		float* tmp_nonzero; 		/** scratch of `n_classes`, frequency of the examples with an entry */
+
+		/**
+		 * @brief view_buffer a buffer for the entries of a column in the node (see `node_column`)
+		 *
+		 * @return buffer of at least `node_end`-`node_begin` entries, kept for the next nodes
+		 */
+		ev_pair_t* view_buffer();
 		/**
 		 * @brief Update the split information (e.g. split feature id, threshold, gain, etc.) if this candidate split is better 
 		 *
@@ -361,9 +619,37 @@ class splitter {
 		 * @param cr criterion to determine the better split (e.g. information gain, gini index)
 		 */
 		virtual void update(int fea_id, float threshold, float*& left, node*& nd, criterion*& cr) = 0;
+		/**
+		 * @brief prefer_scan whether scanning the whole column of a feature (skipping the examples out of the node) is 
+		 * cheaper than looking up the value of each example of the node and sorting them
+		 *
+		 * @param d training dataset
+		 * @param f feature id
+		 *
+		 * @return true to scan the column
+		 */
+		bool prefer_scan(dataset*& d, int f);
+		/**
+		 * @brief node_column the entries of a column which belong to the node being split, sorted by value (examples 
+		 * with the same value in `ex_id` order, as in the column). A dense column has an entry for every example of the node.
+		 *
+		 * @param t tree object
+		 * @param d training dataset
+		 * @param f feature id
+		 * @param view output entries, at least as long as the node
+		 * @param sorted whether the entries must be sorted, otherwise they may be in any order
+		 *
+		 * @return number of entries
+		 */
+		int node_column(tree* t, dataset*& d, int f, ev_pair_t* view, bool sorted = true);
 	public:
+		int node_begin; 			/** first entry of the node being split in `tree::sample` */
+		int node_end; 				/** one past the last entry of the node being split in `tree::sample` */
+		int node_stamp; 			/** stamp of the examples of the node in `tree::in_node` */
+
 		int fea_id;					/** split feature id */
 		float threshold;			/** split threshold */
+		std::vector<unsigned int> cate_set; 	/** categories going left if the split feature is categorical (bit `k` for category `k`) */
 
 		float gain;					/** heuristc measure (e.g. information gain or gini index) improvement after split */
 		
@@ -371,6 +657,26 @@ class splitter {
 		float* left_frequency; 		/** left[j] refers to weighted frequency for class j */
 		float* right_frequency; 	/** right[j] refers to weighted frequency for class j */
 
+		/**
+		 * @brief Randomly choose `max_feature` candidate features among the valid features
+		 *
+		 * @param t tree object
+		 * @param d training dataset
+		 * @param n_candidates number of candidate features
+		 *
+		 * @return array whose first `n_candidates` entries are the candidate features (owned by the splitter, valid until the next call)
+		 */
+		int* sample_features(tree* t, dataset*& d, int& n_candidates);
+		/**
+		 * @brief column_buffer a buffer to decode a column block (see `dataset::get_block`)
+		 *
+		 * @return buffer of `COLUMN_BLOCK_SIZE` entries, kept for the next nodes
+		 */
+		ev_pair_t* column_buffer();
+		/**
+		 * @brief reset forget the split found so far, to search the split of another node
+		 */
+		virtual void reset();
 		/**
 		 * @brief Constructor
 		 *
@@ -407,19 +713,129 @@ class best_splitter : public splitter {
 		 * @param cr criterion to determine the better split (e.g. information gain, gini index)
 		 */
 		void update(int fea_id, float threshold, float*& left, node*& nd, criterion*& cr);
+		/**
+		 * @brief update_k `update` with the gini gain of `K` classes (0: `n_classes`) inlined, see `gini::gain_k`
+		 *
+		 * @param fea_id feature id to split
+		 * @param threshold threshold of the split (less than `threshold` belong to left node)
+		 * @param left pre-computed left node's frequency for each class after the split
+		 * @param nd the node to split
+		 * @param cr gini criterion of `nd`
+		 */
+		template <int K>
+		void update_k(int fea_id, float threshold, const float* left, node*& nd, gini* cr);
+		/**
+		 * @brief Test the splits of a sparse feature, the examples without an entry (zeros) are placed on either side
+		 *
+		 * @param f sparse feature id
+		 * @param view entries of the node sorted by value (see `node_column`)
+		 * @param n number of entries
+		 * @param root the node to split
+		 * @param d training dataset
+		 * @param cr gini criterion of `root`
+		 */
+		template <int K>
+		void split_sparse(int f, const ev_pair_t* view, int n, node*& root, dataset*& d, gini* cr);
+		/**
+		 * @brief Test the splits of a dense feature, every example has a value so there is no zero examples to place
+		 *
+		 * @param f dense feature id
+		 * @param view entries of the node sorted by value (see `node_column`)
+		 * @param n number of entries
+		 * @param root the node to split
+		 * @param d training dataset
+		 * @param cr gini criterion of `root`
+		 */
+		template <int K>
+		void split_dense(int f, const ev_pair_t* view, int n, node*& root, dataset*& d, gini* cr);
+		/**
+		 * @brief Test the cut points of a binned feature, see `split_bins`
+		 *
+		 * @param f feature id
+		 * @param hist class histogram of the node
+		 * @param root the node to split
+		 * @param d training dataset (should be binned)
+		 * @param cr gini criterion of `root`
+		 */
+		template <int K>
+		void split_binned(int f, const float* hist, node*& root, dataset*& d, gini* cr);
+		/**
+		 * @brief Test the splits of a categorical feature. The categories of the node are sorted by the rate of a class 
+		 * and every prefix of this order is tested as the left set, which finds the best partition of a binary problem 
+		 * in O(k log k). A multi-class problem tries the order of each class in turn.
+		 *
+		 * @param f categorical feature id
+		 * @param view entries of the node in any order
+		 * @param n number of entries
+		 * @param root the node to split
+		 * @param d training dataset
+		 * @param cr criterion to determine the better split
+		 */
+		void split_categories(int f, const ev_pair_t* view, int n, node*& root, dataset*& d, criterion*& cr);
+		/**
+		 * @brief split_candidates test the candidate features one after another
+		 *
+		 * @param t tree object
+		 * @param root the node to split
+		 * @param d training dataset
+		 * @param cr criterion of `root` (`set_current` has been called)
+		 * @param candidate_feature candidate features
+		 * @param n_candidates number of candidate features
+		 */
+		void split_candidates(tree* t, node*& root, dataset*& d, criterion*& cr, const int* candidate_feature, int n_candidates);
+		/**
+		 * @brief merge take the split of `s` if it is better than the best so far
+		 *
+		 * @param s splitter which has tested other candidate features of the same node
+		 */
+		void merge(const best_splitter* s);
+	private:
+		std::vector<ev_pair_t> cate_entry; 	/** scratch of `split_categories`, entries grouped by category */
+		std::vector<int> cate_slot; 		/** scratch of `split_categories`, row of each category in `cate_table` */
+		std::vector<int> cate_id; 			/** scratch of `split_categories`, category of each row */
+		std::vector<int> cate_order; 		/** scratch of `split_categories`, rows in the order tested */
+		std::vector<float> cate_table; 		/** scratch of `split_categories`, class frequencies of each category */
+		std::vector<float> cate_tot; 		/** scratch of `split_categories`, total frequency of each category */
+		std::vector<best_splitter*> part; 	/** splitters of the other threads searching a large node, see `split` */
+		std::vector<criterion*> part_cr; 	/** their criteria */
+		int kernel; 		/** number of classes the threshold scans are compiled for (2, 3 or 4), 0 for any number */
 	public: 
 		/**
-		 * @brief Constructor
+		 * @brief Constructor, the threshold scans are chosen here for the number of classes. They inline the gini 
+		 * gain, so the criterion given to `split_feature` and `split_bins` must be a `gini`
 		 *
 		 * @param n_classes different number of classes
 		 */
 		best_splitter(int n_classes);
+		/**
+		 * @brief split_feature test every threshold of one feature, the split is kept if it is better than the best so far
+		 *
+		 * @param f feature id
+		 * @param view entries of the node sorted by value (see `node_column`), in any order for a categorical feature
+		 * @param n number of entries
+		 * @param root the node to split
+		 * @param d training dataset
+		 * @param cr criterion of `root` (`set_current` has been called)
+		 */
+		virtual void split_feature(int f, const ev_pair_t* view, int n, node*& root, dataset*& d, criterion*& cr);
+		/**
+		 * @brief split_bins test the cut points of one feature of a binned dataset, the split is kept if it is better than the best so far
+		 *
+		 * @param f feature id
+		 * @param hist class histogram of the node, `n_bins[f]`*`n_classes` weighted frequencies, zeros included
+		 * @param root the node to split
+		 * @param d training dataset (should be binned)
+		 * @param cr criterion of `root` (`set_current` has been called)
+		 */
+		void split_bins(int f, const float* hist, node*& root, dataset*& d, criterion*& cr);
 		/**
 		 * @brief ~best_splitter Destructor
 		 */
-		~best_splitter();
+		virtual ~best_splitter();
 		/**
-		 * @brief Choose a split
+		 * @brief Choose a split. The candidate features of a node with at least `PARALLEL_SPLIT_MIN_EXAMPLES` examples are
+		 * divided into `t->get_n_threads()` tasks of the scheduler of `t`, each one keeps its own best split and the best 
+		 * of them is taken (the earliest candidate on a tie, as the serial search)
 		 *
 		 * @param t tree object
 		 * @param root one of the node in tree `t` which is to be splited
@@ -430,10 +846,97 @@ class best_splitter : public splitter {
 };
 
 /**
- * @brief Test some random threshold to choose a best split among these 
+ * @brief Test the bin boundaries of a binned dataset (see `dataset::build_bins`) to choose a best split, 
+ * the class histogram of each candidate feature is built with one pass over its column, or derived as parent minus sibling
  */
-class random_splitter : public splitter {
+class hist_splitter : public best_splitter {
+	private:
+		hist_cache_t* cur; 				/** histograms of this node are saved here */
+		const hist_cache_t* parent; 	/** histograms of the parent node, nullptr if not available */
+		const hist_cache_t* sibling; 	/** histograms of the sibling node, nullptr if not available */
+		std::vector<float> hist_buf; 	/** histogram of a candidate when the histograms of the node are not kept */
 
+		/**
+		 * @brief node_histogram build the class histogram of a feature in the node, or derive it as parent minus sibling
+		 *
+		 * @param t tree object
+		 * @param root the node to split
+		 * @param d training dataset (should be binned)
+		 * @param f feature id (not categorical)
+		 * @param hist output histogram, `n_bins[f]`*`n_classes` weighted frequencies, zeros included
+		 */
+		void node_histogram(tree* t, node*& root, dataset*& d, int f, std::vector<float>& hist);
+	public:
+		/**
+		 * @brief Constructor
+		 *
+		 * @param n_classes different number of classes
+		 * @param cur where to save the histograms of this node (can be the same as `sibling`)
+		 * @param parent histograms of the parent node
+		 * @param sibling histograms of the sibling node
+		 */
+		hist_splitter(int n_classes, hist_cache_t* cur, const hist_cache_t* parent, const hist_cache_t* sibling);
+		/**
+		 * @brief set_histograms give the histograms of the next node to split
+		 *
+		 * @param cur where to save the histograms of the node (can be the same as `sibling`)
+		 * @param parent histograms of the parent node
+		 * @param sibling histograms of the sibling node
+		 */
+		void set_histograms(hist_cache_t* cur, const hist_cache_t* parent, const hist_cache_t* sibling);
+		/**
+		 * @brief ~hist_splitter Destructor
+		 */
+		~hist_splitter();
+		/**
+		 * @brief Choose a split. The histograms of the candidates are kept for the children only if they sample enough 
+		 * of the same features to derive some of theirs (see `HIST_KEEP_MIN_REUSE`)
+		 *
+		 * @param t tree object
+		 * @param root one of the node in tree `t` which is to be splited
+		 * @param d training dataset (should be binned)
+		 * @param cr criterion to determine the better split (e.g. information gain, gini index)
+		 */
+		void split(tree* t, node*& root, dataset*& d, criterion*& cr);
+};
+
+/**
+ * @brief Test one random threshold per candidate feature (Extremely Randomized Trees), drawn uniformly between 
+ * the minimum and the maximum value of the node, zeros included. Only the class frequency of each side is counted, 
+ * so the entries of the node need not be sorted.
+ */
+class random_splitter : public best_splitter {
+	public: 
+		/**
+		 * @brief Constructor
+		 *
+		 * @param n_classes different number of classes
+		 */
+		random_splitter(int n_classes);
+		/**
+		 * @brief ~random_splitter Destructor
+		 */
+		~random_splitter();
+		/**
+		 * @brief split_feature test a random threshold of one feature, the split is kept if it is better than the best so far
+		 *
+		 * @param f feature id
+		 * @param view entries of the node in any order
+		 * @param n number of entries
+		 * @param root the node to split
+		 * @param d training dataset
+		 * @param cr criterion of `root` (`set_current` has been called)
+		 */
+		void split_feature(int f, const ev_pair_t* view, int n, node*& root, dataset*& d, criterion*& cr);
+		/**
+		 * @brief Choose a split
+		 *
+		 * @param t tree object
+		 * @param root one of the node in tree `t` which is to be splited
+		 * @param d training dataset
+		 * @param cr criterion to determine the better split (e.g. information gain, gini index)
+		 */
+		void split(tree* t, node*& root, dataset*& d, criterion*& cr);	
 };
 
 /**
@@ -446,6 +949,19 @@ class criterion {
 		float cur_tot; 			/** current node total frequency */
 
 		bool is_init; 			/** has set the current node measure */
+
+		/**
+		 * @brief combine the gain of a split from the measures of the children, 
+		 * cur_measure - left_tot / cur_tot * left_measure - right_tot / cur_tot * right_measure, each child is weighted by its own measure
+		 *
+		 * @param left_measure heuristic measure of the left node
+		 * @param left_tot total frequency of the left node
+		 * @param right_measure heuristic measure of the right node
+		 * @param right_tot total frequency of the right node
+		 *
+		 * @return heurist measure value gain
+		 */
+		inline float combine(float left_measure, float left_tot, float right_measure, float right_tot);
 	public:
 		/**
 		 * @brief Constructor (need to call `set_current` function manually)
@@ -479,7 +995,7 @@ class criterion {
 		 *
 		 * @return heurist measure value gain 
 		 */
-		float gain(float*& left_frequency, float*& right_frequency, int n_classes);
+		virtual float gain(float*& left_frequency, float*& right_frequency, int n_classes);
 
 		/**
 		 * @brief Heuristic measure value
@@ -493,10 +1009,27 @@ class criterion {
 };
 
 /**
- * @brief Gini index
+ * @brief Gini index, the only criterion. The scans of `best_splitter` are specialized for it (`gain_k`), 
+ * there is no entropy criterion and so no entropy kernel, another criterion would go through the virtual `gain`.
  */
 class gini : public criterion {
+	protected:
+		/**
+		 * @brief impurity gini index of a node, 1 - sum(frequency^2) / tot^2, the one kernel of `measure` and `gain`
+		 *
+		 * @param frequency frequency for each class in the node
+		 * @param n_classes number of different classes, unused if `K` is positive
+		 * @param tot total frequency of the node (output)
+		 *
+		 * @return gini index
+		 */
+		template <int K>
+		static inline float impurity(const float* frequency, int n_classes, float& tot);
 	public:
+		/**
+		 * @brief Constructor (need to call `set_current` function manually)
+		 */
+		gini();
 		/**
 		 * @brief Constructor
 		 *
@@ -517,4 +1050,99 @@ class gini : public criterion {
 		 * @return heuristic measure value
 		 */
 		float measure(float*& frequency, int n_classes);
+		/**
+		 * @brief Heuristic measure value gain after the split, the measures of the children are computed inline
+		 *
+		 * @param left_frequency left node's frequency
+		 * @param right_frequency right node's frequency
+		 * @param n_classes number of different classes
+		 *
+		 * @return heurist measure value gain 
+		 */
+		float gain(float*& left_frequency, float*& right_frequency, int n_classes);
+		/**
+		 * @brief gain_k `gain` for `K` classes known at compile time (0: `n_classes`), a splitter which tests every 
+		 * threshold with it has the loops over the classes unrolled and no virtual call per threshold
+		 *
+		 * @param left_frequency left node's frequency
+		 * @param right_frequency right node's frequency
+		 * @param n_classes number of different classes, unused if `K` is positive
+		 *
+		 * @return heurist measure value gain 
+		 */
+		template <int K>
+		inline float gain_k(const float* left_frequency, const float* right_frequency, int n_classes);
+};
+
+inline float criterion::combine(float left_measure, float left_tot, float right_measure, float right_tot) {
+	/* need to set current node before call gain function */
+	if (!is_init) {
+		std::cerr << "Please set current measure before call gain" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	/* return gain value */
+	return this->cur_measure 
+		- (left_tot / this->cur_tot * left_measure)
+		- (right_tot / this->cur_tot * right_measure);
+}
+
+template <int K>
+inline float gini::impurity(const float* frequency, int n_classes, float& tot) {
+	const int m = K > 0 ? K : n_classes;
+	float sum_sq = 0.0;
+
+	/* one division instead of one per class */
+	tot = 0.0;
+	for (int c = 0; c < m; c++) {
+		tot += frequency[c];
+		sum_sq += frequency[c]*frequency[c];
+	}
+	return 1.0f - sum_sq / (tot*tot);
+}
+
+template <int K>
+inline float gini::gain_k(const float* left_frequency, const float* right_frequency, int n_classes) {
+	float left_tot, right_tot, left_measure, right_measure;
+
+	left_measure = impurity<K>(left_frequency, n_classes, left_tot);
+	right_measure = impurity<K>(right_frequency, n_classes, right_tot);
+	return combine(left_measure, left_tot, right_measure, right_tot);
+}
+
+/**
+ * @brief The splitter and the criterion a thread uses for every node it splits, kept from one node 
+ * (and one tree) to the next with the buffers of the splitter
+ */
+class split_workspace {
+	private:
+		split_mode split; 	/** kind of `s` */
+		int n_classes; 		/** number of different classes */
+		bool busy; 			/** a node is being split with it */
+		split_workspace* nested; /** next workspace of the same worker, made when this one is busy */
+	public:
+		splitter* s; 		/** splitter of the nodes, of the kind given by the `split_mode` */
+		criterion* cr; 		/** criterion of the nodes */
+
+		/**
+		 * @brief Constructor
+		 *
+		 * @param split how the trees choose the split thresholds
+		 * @param n_classes number of different classes
+		 */
+		split_workspace(split_mode split, int n_classes);
+		/**
+		 * @brief Destructor, also of the nested workspaces
+		 */
+		~split_workspace();
+		/**
+		 * @brief acquire take the first workspace of the chain which is not busy, a worker which waits for the tasks of 
+		 * a split runs other tasks meanwhile, and a node split by one of them must not use the workspace of the waiting one
+		 *
+		 * @return workspace to split a node with, `release` it once the examples are partitioned
+		 */
+		split_workspace* acquire();
+		/**
+		 * @brief release make the workspace free for the next node of the worker
+		 */
+		void release();
 };
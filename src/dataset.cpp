@@ -9,330 +9,2550 @@
 
 example_t::example_t() {
 	nnz = 0;
+	capacity = 1;
 	y = -1;
-	fea_id = new int[1];
-	fea_value = new feature_t[1];
+	fea_id = (int*)malloc(sizeof(int)*capacity);
+	fea_value = (feature_t*)malloc(sizeof(feature_t)*capacity);
 }
 
 example_t::~example_t() {
 	if (fea_id != nullptr) {
-		delete[] fea_id;
+		free(fea_id);
 		fea_id = nullptr;
 	}
 	if (fea_value != nullptr) {
-		delete[] fea_value;
+		free(fea_value);
 		fea_value = nullptr;
 	}
 }
 
 void example_t::push_back(int id, feature_t value) {
-	fea_id = (int*)realloc(fea_id, sizeof(int)*(nnz+1));
-	fea_value = (feature_t*)realloc(fea_value, sizeof(int)*(nnz+1));
+	/* grow geometrically, so pushing n entries only reallocs O(log n) times */
+	if (nnz == capacity) {
+		capacity *= 2;
+		fea_id = (int*)realloc(fea_id, sizeof(int)*capacity);
+		fea_value = (feature_t*)realloc(fea_value, sizeof(feature_t)*capacity);
+	}
+
+	fea_id[nnz] = id;
+	fea_value[nnz] = value;
+
+	nnz++;
+}
+
+void example_t::debug() {
+	if (y != -1) {
+		std::cout << "Example Label: " << y << std::endl;
+	}
+	std::cout << "Features: " << std::endl;
+	for (int i = 0; i < nnz; i++) {
+		std::cout << fea_id[i] << ":" << fea_value[i] << " ";
+	}
+	std::cout << std::endl << std::endl;
+}
+
+example_batch::example_batch() {
+	row_ptr.push_back(0);
+}
+
+example_batch::example_batch(const std::vector<example_t*>& examples) {
+	size_t nnz = 0;
+	for (auto it = examples.begin(); it != examples.end(); it++) nnz += (*it)->nnz;
+	y.reserve(examples.size());
+	row_ptr.reserve(examples.size() + 1);
+	fea_id.reserve(nnz);
+	fea_value.reserve(nnz);
+
+	row_ptr.push_back(0);
+	for (auto it = examples.begin(); it != examples.end(); it++) push_back(**it);
+}
+
+void example_batch::push_back(const example_t& ex) {
+	y.push_back(ex.y);
+	fea_id.insert(fea_id.end(), ex.fea_id, ex.fea_id + ex.nnz);
+	fea_value.insert(fea_value.end(), ex.fea_value, ex.fea_value + ex.nnz);
+	row_ptr.push_back(fea_id.size());
+}
+
+void example_batch::clear() {
+	y.clear();
+	row_ptr.assign(1, 0);
+	fea_id.clear();
+	fea_value.clear();
+}
+
+int example_batch::get_n_examples() const {
+	return (int)y.size();
+}
+
+size_t example_batch::get_nnz() const {
+	return fea_id.size();
+}
+
+void example_t::assign(int nnz, const int* id, const feature_t* value) {
+	if (nnz > capacity) {
+		capacity = nnz;
+		fea_id = (int*)realloc(fea_id, sizeof(int)*capacity);
+		fea_value = (feature_t*)realloc(fea_value, sizeof(feature_t)*capacity);
+	}
+	this->nnz = nnz;
+	memcpy(fea_id, id, sizeof(int)*nnz);
+	memcpy(fea_value, value, sizeof(feature_t)*nnz);
+}
+
+compressed_column::compressed_column() {
+	n = n_blocks = n_dict = 0;
+	id_data = nullptr;
+	block_offset = nullptr;
+	dict = nullptr;
+	run_start = nullptr;
+	value = nullptr;
+}
+
+compressed_column::~compressed_column() {
+	if (id_data != nullptr) {
+		delete[] id_data;
+		id_data = nullptr;
+	}
+	if (block_offset != nullptr) {
+		delete[] block_offset;
+		block_offset = nullptr;
+	}
+	if (dict != nullptr) {
+		delete[] dict;
+		dict = nullptr;
+	}
+	if (run_start != nullptr) {
+		delete[] run_start;
+		run_start = nullptr;
+	}
+	if (value != nullptr) {
+		delete[] value;
+		value = nullptr;
+	}
+}
+
+void compressed_column::encode(const ev_pair_t* a, int n) {
+	std::vector<unsigned char> bytes;
+	uint32_t prev = 0, d, z;
+	int j;
+
+	this->n = n;
+	this->n_blocks = (n + COLUMN_BLOCK_SIZE - 1) / COLUMN_BLOCK_SIZE;
+	block_offset = new size_t[n_blocks+1];
+
+	/* example ids, zigzag so that a negative delta (a new run of value) is still short */
+	bytes.reserve(n + n/2);
+	for (j = 0; j < n; j++) {
+		if (j % COLUMN_BLOCK_SIZE == 0) {
+			block_offset[j / COLUMN_BLOCK_SIZE] = bytes.size();
+			prev = 0;
+		}
+		d = (uint32_t)a[j].ex_id - prev;
+		z = (d << 1) ^ (uint32_t)((int32_t)d >> 31);
+		while (z >= 0x80) {
+			bytes.push_back((unsigned char)(z | 0x80));
+			z >>= 7;
+		}
+		bytes.push_back((unsigned char)z);
+		prev = (uint32_t)a[j].ex_id;
+	}
+	block_offset[n_blocks] = bytes.size();
+	id_data = new unsigned char[bytes.size() > 0 ? bytes.size() : 1];
+	if (bytes.size() > 0) memcpy(id_data, bytes.data(), bytes.size());
+
+	/* values, a run costs a value and an index while a raw value costs a value */
+	n_dict = 0;
+	for (j = 0; j < n; j++) {
+		if (j == 0 || a[j].fea_value != a[j-1].fea_value) n_dict++;
+	}
+	if (2*n_dict <= n) {
+		dict = new feature_t[n_dict > 0 ? n_dict : 1];
+		run_start = new int[n_dict+1];
+		n_dict = 0;
+		for (j = 0; j < n; j++) {
+			if (j == 0 || a[j].fea_value != a[j-1].fea_value) {
+				dict[n_dict] = a[j].fea_value;
+				run_start[n_dict++] = j;
+			}
+		}
+		run_start[n_dict] = n;
+	} else {
+		n_dict = 0;
+		value = new feature_t[n];
+		for (j = 0; j < n; j++) value[j] = a[j].fea_value;
+	}
+}
+
+int compressed_column::decode_block(int b, ev_pair_t* out) const {
+	const unsigned char* p = id_data + block_offset[b];
+	int begin = b*COLUMN_BLOCK_SIZE, len = std::min(COLUMN_BLOCK_SIZE, n - begin), shift, k;
+	uint32_t prev = 0, z;
+
+	for (int j = 0; j < len; j++) {
+		z = 0;
+		shift = 0;
+		while (*p & 0x80) {
+			z |= (uint32_t)(*p++ & 0x7f) << shift;
+			shift += 7;
+		}
+		z |= (uint32_t)(*p++) << shift;
+		prev += (z >> 1) ^ (0u - (z & 1));
+		out[j].ex_id = (int)prev;
+	}
+
+	if (n_dict > 0) {
+		/* the run which contains the first entry of the block */
+		k = std::upper_bound(run_start, run_start + n_dict + 1, begin) - run_start - 1;
+		for (int j = 0; j < len; j++) {
+			while (run_start[k+1] <= begin + j) k++;
+			out[j].fea_value = dict[k];
+		}
+	} else {
+		for (int j = 0; j < len; j++) out[j].fea_value = value[begin + j];
+	}
+	return len;
+}
+
+int compressed_column::upper_bound(feature_t v) const {
+	if (n_dict > 0) 
+		return run_start[std::upper_bound(dict, dict + n_dict, v) - dict];
+	return std::upper_bound(value, value + n, v) - value;
+}
+
+size_t compressed_column::memory_usage() const {
+	return block_offset[n_blocks] + sizeof(size_t)*(n_blocks+1) 
+		+ (n_dict > 0 ? (sizeof(feature_t) + sizeof(int))*n_dict + sizeof(int) : sizeof(feature_t)*n);
+}
+
+column_pool::column_pool(int fd, long long data_offset, int n_features, const int* size, size_t budget) {
+	this->fd = fd;
+	this->n_features = n_features;
+	this->size = size;
+	this->budget = budget;
+	this->used = 0;
+	this->n_hits = this->n_misses = 0;
+	offset.resize(n_features);
+	column.assign(n_features, nullptr);
+	lru_pos.resize(n_features);
+	for (int f = 0; f < n_features; f++) {
+		offset[f] = data_offset;
+		data_offset += (long long)sizeof(ev_pair_t)*size[f];
+	}
+}
+
+column_pool::~column_pool() {
+	for (int f = 0; f < n_features; f++) {
+		if (column[f] != nullptr) {
+			delete[] column[f];
+			column[f] = nullptr;
+		}
+	}
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+}
+
+const ev_pair_t* column_pool::page_in(int f) {
+	size_t bytes = sizeof(ev_pair_t)*size[f], done = 0;
+	ssize_t ret;
+	int victim;
+
+	if (column[f] != nullptr) {
+		n_hits++;
+		lru.splice(lru.begin(), lru, lru_pos[f]);
+		return column[f];
+	}
+
+	/* evict the least recently used columns */
+	while (!lru.empty() && used + bytes > budget) {
+		victim = lru.back();
+		lru.pop_back();
+		delete[] column[victim];
+		column[victim] = nullptr;
+		used -= sizeof(ev_pair_t)*size[victim];
+	}
+
+	n_misses++;
+	column[f] = new ev_pair_t[size[f] > 0 ? size[f] : 1];
+	while (done < bytes) {
+		ret = pread(fd, (char*)column[f] + done, bytes - done, offset[f] + done);
+		if (ret <= 0) {
+			std::cerr << "Fail to read column " << f << " from the cache file" << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		done += ret;
+	}
+	used += bytes;
+	lru.push_front(f);
+	lru_pos[f] = lru.begin();
+	return column[f];
+}
+
+int column_pool::read_block(int f, int b, ev_pair_t* buf) {
+	std::lock_guard<std::mutex> guard(mtx);
+	const ev_pair_t* col = page_in(f);
+	int n = std::min(COLUMN_BLOCK_SIZE, size[f] - b*COLUMN_BLOCK_SIZE);
+
+	memcpy(buf, col + b*COLUMN_BLOCK_SIZE, sizeof(ev_pair_t)*n);
+	return n;
+}
+
+int column_pool::upper_bound(int f, feature_t v) {
+	std::lock_guard<std::mutex> guard(mtx);
+	const ev_pair_t* col = page_in(f);
+	int k = 0, u = size[f], m;
+
+	while (k < u) {
+		m = (k + u) / 2;
+		if (col[m].fea_value > v)
+			u = m;
+		else 
+			k = m + 1;
+	}
+	return k;
+}
+
+void column_pool::print_stats() {
+	std::lock_guard<std::mutex> guard(mtx);
+	std::cout << "Column pool: " << n_hits << " hits, " << n_misses << " misses, " 
+		<< used / 1048576.0 << " MB resident of " << budget / 1048576.0 << " MB budget" << std::endl;
+}
+
+data_reader::data_reader(const std::string& filename, int n_features, const learn_mode mode, const data_format format) {
+	static const unsigned char gzip_magic[] = {0x1f, 0x8b};
+	static const unsigned char xz_magic[] = {0xfd, 0x37, 0x7a, 0x58, 0x5a, 0x00};
+	static const unsigned char zstd_magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+	struct stat st;
+	char* file;
+	size_t file_size;
+
+	fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		std::cerr << "Can not open file " << filename << " ." << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	file = nullptr;
+	file_size = st.st_size;
+	/* an empty file can not be mapped, just treat it as no examples */
+	if (file_size > 0) {
+		file = (char*)mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (file == MAP_FAILED) {
+			std::cerr << "Can not map file " << filename << " into memory." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		/* the file is scanned from begin to end only once */
+		madvise(file, file_size, MADV_SEQUENTIAL);
+	}
+
+	compression = NO_COMPRESSION;
+	if (file_size >= sizeof(gzip_magic) && memcmp(file, gzip_magic, sizeof(gzip_magic)) == 0) compression = GZIP_COMPRESSION;
+	if (file_size >= sizeof(xz_magic) && memcmp(file, xz_magic, sizeof(xz_magic)) == 0) compression = XZ_COMPRESSION;
+	if (file_size >= sizeof(zstd_magic) && memcmp(file, zstd_magic, sizeof(zstd_magic)) == 0) compression = ZSTD_COMPRESSION;
+#ifndef RF_WITH_ZSTD
+	if (compression == ZSTD_COMPRESSION) {
+		std::cerr << "File " << filename << " is zstd compressed, please rebuild with ZSTD=1." << std::endl;
+		exit(EXIT_FAILURE);
+	}
+#endif
+
+	n_buckets = 0;
+	bucket_owner = nullptr;
+	n_merged = 0;
+	stream_done = true;
+	stream_stop = false;
+	chunk_complete = false;
+	n_released = 0;
+	released = 0;
+	if (compression == NO_COMPRESSION) {
+		src = nullptr;
+		src_size = 0;
+		capacity = 0;
+		buf = file;
+		buf_size = file_size;
+	} else {
+		src = file;
+		src_size = file_size;
+		/* reserve address space for the whole decompressed file, so `buf` never moves while it is being parsed;
+		 * pages are only allocated when they are written */
+		buf = (char*)MAP_FAILED;
+		for (capacity = (size_t)1 << 40; capacity >= ((size_t)1 << 30); capacity >>= 1) {
+			buf = (char*)mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+			if (buf != MAP_FAILED) break;
+		}
+		if (buf == MAP_FAILED) {
+			std::cerr << "Can not reserve memory to decompress file " << filename << " ." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		buf_size = 0;
+		stream_done = false;
+		decompressor = std::thread(&data_reader::decompress, this);
+	}
+	cur = buf;
+	end = buf + buf_size;
+
+	this->n_features = n_features;
+	this->mode = mode;
+	this->format = format;
+
+	/* a dense file may start with a line of column names */
+	if (format == DENSE) {
+		end = buf + wait_data(0);
+		while (cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\r')) cur++;
+		if (cur < end && *cur != '#' && *cur != '\n' && !isdigit(*cur) && *cur != '-' && *cur != '+' && *cur != '.') {
+			while (cur < end && *cur++ != '\n');
+		} else {
+			cur = buf;
+		}
+	}
+}
+
+data_reader::~data_reader() {
+	if (bucket_owner != nullptr) {
+		delete[] bucket_owner;
+		bucket_owner = nullptr;
+	}
+	if (decompressor.joinable()) {
+		stream_stop = true;
+		decompressor.join();
+	}
+	if (src != nullptr) {
+		munmap(src, src_size);
+		src = nullptr;
+		munmap(buf, capacity);
+		buf = nullptr;
+	}
+	if (buf != nullptr) {
+		munmap(buf, buf_size);
+		buf = nullptr;
+	}
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+}
+
+size_t data_reader::get_file_size() {
+	return wait_data((size_t)-1);
+}
+
+void data_reader::publish(size_t size, bool done, const std::string& error) {
+	{
+		std::lock_guard<std::mutex> guard(stream_mtx);
+		buf_size = size;
+		stream_done = done;
+		stream_error = error;
+	}
+	stream_cv.notify_all();
+}
+
+void data_reader::release(size_t pos) {
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	/* the page `pos` is in may still be read */
+	pos = pos / page * page;
+	if (src == nullptr || pos <= released) return;
+	madvise(buf + released, pos - released, MADV_DONTNEED);
+	released = pos;
+}
+
+size_t data_reader::wait_data(size_t pos) {
+	std::unique_lock<std::mutex> lock(stream_mtx);
+	size_t avail;
+
+	while (true) {
+		avail = buf_size;
+		if (stream_done || (avail > pos && memchr(buf + pos, '\n', avail - pos) != nullptr)) return avail;
+		stream_cv.wait(lock, [&]() { return stream_done || buf_size > avail; });
+	}
+}
+
+void data_reader::decompress() {
+	const size_t piece = 1 << 22; /* publish the output every 4MB */
+	size_t out_pos = 0;
+	bool finished = false, failed = false;
+
+	if (compression == GZIP_COMPRESSION) {
+		const size_t max_in = 1 << 30; /* `avail_in` of zlib is 32 bits */
+		size_t in_pos = 0;
+		z_stream zs;
+		int ret;
+
+		memset(&zs, 0, sizeof(zs));
+		if (inflateInit2(&zs, 15 + 16) != Z_OK) failed = true;
+		while (!failed && !finished && !stream_stop && out_pos < capacity) {
+			if (zs.avail_in == 0 && in_pos < src_size) {
+				zs.next_in = (Bytef*)src + in_pos;
+				zs.avail_in = (uInt)std::min(max_in, src_size - in_pos);
+				in_pos += zs.avail_in;
+			}
+			zs.next_out = (Bytef*)buf + out_pos;
+			zs.avail_out = (uInt)std::min(piece, capacity - out_pos);
+			ret = inflate(&zs, Z_NO_FLUSH);
+			out_pos = (char*)zs.next_out - buf;
+			if (ret == Z_STREAM_END) {
+				/* a file may have several gzip members, e.g. written by `pigz` or `cat a.gz b.gz` */
+				if (zs.avail_in == 0 && in_pos == src_size) 
+					finished = true;
+				else 
+					inflateReset(&zs);
+			} else if ((ret != Z_OK && ret != Z_BUF_ERROR) || (zs.avail_in == 0 && in_pos == src_size && zs.avail_out > 0)) {
+				failed = true;
+			}
+			publish(out_pos, false);
+		}
+		inflateEnd(&zs);
+	} else if (compression == XZ_COMPRESSION) {
+		lzma_stream ls = LZMA_STREAM_INIT;
+		lzma_ret ret;
+
+		if (lzma_stream_decoder(&ls, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) failed = true;
+		ls.next_in = (const uint8_t*)src;
+		ls.avail_in = src_size;
+		while (!failed && !finished && !stream_stop && out_pos < capacity) {
+			ls.next_out = (uint8_t*)buf + out_pos;
+			ls.avail_out = std::min(piece, capacity - out_pos);
+			/* the whole input is given, so always finish */
+			ret = lzma_code(&ls, LZMA_FINISH);
+			out_pos = (char*)ls.next_out - buf;
+			if (ret == LZMA_STREAM_END) 
+				finished = true;
+			else if (ret != LZMA_OK) 
+				failed = true;
+			publish(out_pos, false);
+		}
+		lzma_end(&ls);
+	} else if (compression == ZSTD_COMPRESSION) {
+#ifdef RF_WITH_ZSTD
+		ZSTD_DCtx* zd = ZSTD_createDCtx();
+		ZSTD_inBuffer in = {src, src_size, 0};
+		ZSTD_outBuffer out;
+		size_t ret;
+
+		if (zd == nullptr) failed = true;
+		while (!failed && !finished && !stream_stop && out_pos < capacity) {
+			out.dst = buf + out_pos;
+			out.size = std::min(piece, capacity - out_pos);
+			out.pos = 0;
+			ret = ZSTD_decompressStream(zd, &out, &in);
+			out_pos += out.pos;
+			if (ZSTD_isError(ret)) 
+				failed = true;
+			else if (in.pos == in.size && ret == 0) 
+				finished = true;
+			else if (in.pos == in.size && out.pos < out.size) 
+				failed = true;
+			publish(out_pos, false);
+		}
+		if (zd != nullptr) ZSTD_freeDCtx(zd);
+#endif
+	}
+
+	if (stream_stop) return;
+	/* the error is reported by the parsing thread, see `check_stream` */
+	if (failed) 
+		publish(out_pos, true, "Fail to decompress the input file, it may be truncated or corrupted.");
+	else if (!finished) 
+		publish(out_pos, true, "The decompressed input file is larger than " + std::to_string(capacity >> 30) + " GB.");
+	else 
+		publish(out_pos, true);
+}
+
+bool data_reader::has_stream_error() {
+	std::lock_guard<std::mutex> guard(stream_mtx);
+	return !stream_error.empty();
+}
+
+void data_reader::check_stream() {
+	std::lock_guard<std::mutex> guard(stream_mtx);
+
+	if (!stream_error.empty()) {
+		std::cerr << stream_error << std::endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+void data_reader::set_feature_hash(int n_buckets) {
+	this->n_buckets = n_buckets;
+	if (bucket_owner != nullptr) {
+		delete[] bucket_owner;
+		bucket_owner = nullptr;
+	}
+	if (n_buckets > 0) {
+		bucket_owner = new std::atomic<int>[n_buckets];
+		for (int b = 0; b < n_buckets; b++) bucket_owner[b] = -1;
+	}
+	n_merged = 0;
+}
+
+int data_reader::hash_feature(int feature_id) {
+	/* finalizer of murmur3, so that nearby ids go to unrelated buckets */
+	uint32_t h = (uint32_t)feature_id;
+	int b, owner, expected;
+
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	b = (int)(h % (uint32_t)n_buckets);
+
+	/* the owner only changes twice at most, so it is mostly read */
+	owner = bucket_owner[b].load(std::memory_order_relaxed);
+	if (owner != feature_id && owner != -2) {
+		expected = -1;
+		if (!bucket_owner[b].compare_exchange_strong(expected, feature_id, std::memory_order_relaxed) && expected != feature_id) 
+			bucket_owner[b].store(-2, std::memory_order_relaxed);
+	}
+	return b;
+}
+
+void data_reader::merge_collisions(std::vector<int>& id, std::vector<feature_t>& value, size_t first) {
+	thread_local std::vector<std::pair<int, feature_t> > entry;
+	size_t n = id.size() - first, k = 0;
+
+	if (n < 2) return;
+	entry.resize(n);
+	for (size_t j = 0; j < n; j++) entry[j] = std::make_pair(id[first+j], value[first+j]);
+	std::sort(entry.begin(), entry.end(), [](const std::pair<int, feature_t>& a, const std::pair<int, feature_t>& b) { return a.first < b.first; });
+	for (size_t j = 0; j < n; j++) {
+		if (k > 0 && entry[j].first == id[first+k-1]) {
+			value[first+k-1] += entry[j].second;
+		} else {
+			id[first+k] = entry[j].first;
+			value[first+k] = entry[j].second;
+			k++;
+		}
+	}
+	if (k < n) {
+		n_merged += n - k;
+		id.resize(first + k);
+		value.resize(first + k);
+	}
+}
+
+void data_reader::print_hash_stats() {
+	long long n_used = 0, n_shared = 0;
+	int owner;
+
+	if (n_buckets <= 0) return;
+	for (int b = 0; b < n_buckets; b++) {
+		owner = bucket_owner[b].load(std::memory_order_relaxed);
+		if (owner != -1) n_used++;
+		if (owner == -2) n_shared++;
+	}
+	std::cout << "Feature hashing: " << n_used << " of " << n_buckets << " buckets used, " << n_shared 
+		<< " shared by several raw ids, " << n_merged << " entries merged within a line" << std::endl;
+}
+
+void data_reader::set_feature_filter(const std::vector<int>& features) {
+	int max_id = -1;
+
+	for (size_t i = 0; i < features.size(); i++) max_id = std::max(max_id, features[i]);
+	keep.assign(std::max(n_features, max_id + 1), 0);
+	for (size_t i = 0; i < features.size(); i++) {
+		if (features[i] >= 0) keep[features[i]] = 1;
+	}
+}
+
+bool data_reader::is_dropped(int feature_id) const {
+	if (keep.empty()) return false;
+	/* a feature id beyond `n_features` is not dropped, so that it is reported */
+	if (feature_id < 0 || feature_id >= (int)keep.size()) return n_features <= 0;
+	return !keep[feature_id];
+}
+
+int data_reader::parse_int(const char*& p, const char* end) {
+	int ret = 0;
+	bool neg = false;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		neg = (*p == '-');
+		p++;
+	}
+	while (p < end && (unsigned)(*p - '0') < 10) {
+		ret = ret*10 + (*p - '0');
+		p++;
+	}
+	return neg ? -ret : ret;
+}
+
+double data_reader::parse_float(const char*& p, const char* end) {
+	/* exact powers of ten representable in double */
+	static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+	const char* begin = p;
+	uint64_t mantissa = 0;
+	int n_digits = 0, exp10 = 0, e;
+	bool neg = false, has_digits = false;
+	double ret;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		neg = (*p == '-');
+		p++;
+	}
+	/* `nan`, `inf` and friends are rare, leave them to the C library */
+	if (p < end && (*p == 'n' || *p == 'N' || *p == 'i' || *p == 'I')) {
+		char tmp[32];
+		char* tail;
+		int len = 0;
+		while (p < end && len < 31 && !isspace(*p) && *p != ',') tmp[len++] = *p++;
+		tmp[len] = '\0';
+		ret = strtod(tmp, &tail);
+		/* `NA`, `null` or `nan` is a missing value, not a number */
+		if (*tail != '\0' || std::isnan(ret)) {
+			p = begin;
+			return 0.0;
+		}
+		return neg ? -ret : ret;
+	}
+	/* integer part, only the first 19 significant digits fit in `mantissa` */
+	while (p < end && (unsigned)(*p - '0') < 10) {
+		if (n_digits < 19) {
+			mantissa = mantissa*10 + (*p - '0');
+			if (mantissa > 0) n_digits++;
+		} else {
+			exp10++;
+		}
+		p++;
+		has_digits = true;
+	}
+	/* fractional part */
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && (unsigned)(*p - '0') < 10) {
+			if (n_digits < 19) {
+				mantissa = mantissa*10 + (*p - '0');
+				if (mantissa > 0) n_digits++;
+				exp10--;
+			}
+			p++;
+			has_digits = true;
+		}
+	}
+	/* a lone sign or point is not a number either */
+	if (!has_digits) {
+		p = begin;
+		return 0.0;
+	}
+	/* exponent part */
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		e = parse_int(p, end);
+		exp10 += e;
+	}
+
+	ret = (double)mantissa;
+	if (mantissa != 0) {
+		if (exp10 < 0) {
+			ret = -exp10 <= 22 ? ret / pow10[-exp10] : ret * pow(10.0, exp10);
+		} else if (exp10 > 0) {
+			ret = exp10 <= 22 ? ret * pow10[exp10] : ret * pow(10.0, exp10);
+		}
+	}
+	return neg ? -ret : ret;
+}
+
+bool data_reader::parse_line(const char*& p, const char* end, target_t& y, std::vector<int>& id, std::vector<feature_t>& value) {
+	const char* q;
+	int feature_id;
+	feature_t feature_value;
+	size_t first = id.size();
+
+	if (format == DENSE) return parse_dense_line(p, end, y, id, value);
+
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+	/* blank line or comment line */
+	if (p == end || *p == '\n' || *p == '#') {
+		while (p < end && *p++ != '\n');
+		return false;
+	}
+
+	if (mode != TEST) {
+		/* read label */
+		y = (target_t)parse_float(p, end);
+	} else {
+		/* test file may still have labels, skip the first token if it is not a `feature_id:feature_value` pair */
+		for (q = p; q < end && *q != ':' && !isspace(*q); q++);
+		if (q == end || *q != ':') p = q;
+	}
+
+	while (true) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+		if (p == end || *p == '\n' || *p == '#') break;
+
+		// libsvm format `feature_id` start from 1, we set it to start with 0
+		feature_id = parse_int(p, end) - 1;
+		if (p == end || *p != ':') {
+			std::cerr << "input file has a bad `feature_id:feature_value` pair near feature id " << feature_id + 1 << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		p++;
+		if (feature_id < 0) {
+			std::cerr << "input file feature id " << feature_id + 1 << " is not a positive integer" << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		if (n_buckets > 0) feature_id = hash_feature(feature_id);
+		if (is_dropped(feature_id)) {
+			/* skip the value without converting it */
+			while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+			continue;
+		}
+		q = p;
+		feature_value = (feature_t)parse_float(p, end);
+		if (p == q) {
+			/* not a number, e.g. `NA` or `?`, the entry is missing */
+			while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+			continue;
+		}
+
+		if (n_features > 0 && feature_id >= n_features) {
+			std::cerr << "input file feature id " << feature_id << " exceed `n_features` " << n_features << std::endl;
+			exit(EXIT_FAILURE);
+		}
+
+		id.push_back(feature_id);
+		value.push_back(feature_value);
+	}
+	if (n_buckets > 0) merge_collisions(id, value, first);
+
+	/* move to the begin of next line */
+	while (p < end && *p++ != '\n');
+	return true;
+}
+
+bool data_reader::parse_dense_line(const char*& p, const char* end, target_t& y, std::vector<int>& id, std::vector<feature_t>& value) {
+	const char* q;
+	int feature_id = -1; /* the label field */
+	int fid; 			/* stored id of the field, which is `feature_id` or its bucket */
+	feature_t feature_value;
+	size_t first = id.size();
+
+	while (p < end && (*p == ' ' || *p == '\r')) p++;
+	/* blank line or comment line */
+	if (p == end || *p == '\n' || *p == '#') {
+		while (p < end && *p++ != '\n');
+		return false;
+	}
+
+	while (true) {
+		while (p < end && (*p == ' ' || *p == '\r')) p++;
+		q = p;
+		fid = (n_buckets > 0 && feature_id >= 0) ? hash_feature(feature_id) : feature_id;
+		if (fid >= 0 && is_dropped(fid)) {
+			/* skip the field without converting it */
+			while (p < end && *p != ',' && *p != '\t' && *p != '\n') p++;
+		} else if (p < end && *p != ',' && *p != '\t' && *p != '\n') {
+			feature_value = (feature_t)parse_float(p, end);
+			while (p < end && (*p == ' ' || *p == '\r')) p++;
+			if (p == q || (p < end && *p != ',' && *p != '\t' && *p != '\n')) {
+				/* not a number, e.g. `NA` or `?`, treat it as missing */
+				while (p < end && *p != ',' && *p != '\t' && *p != '\n') p++;
+			} else if (feature_id < 0) {
+				if (mode != TEST) y = (target_t)feature_value;
+			} else {
+				if (n_features > 0 && fid >= n_features) {
+					std::cerr << "input file feature id " << fid << " exceed `n_features` " << n_features << std::endl;
+					exit(EXIT_FAILURE);
+				}
+				id.push_back(fid);
+				value.push_back(feature_value);
+			}
+		}
+		if (p == end || *p == '\n') break;
+		/* skip the delimiter */
+		p++;
+		feature_id++;
+	}
+	if (n_buckets > 0) merge_collisions(id, value, first);
+
+	/* move to the begin of next line */
+	if (p < end) p++;
+	return true;
+}
+
+example_t* data_reader::read_an_example() {
+	example_t* ret;
+	target_t y = -1;
+
+	while (true) {
+		/* a whole line must be decompressed before it is parsed */
+		end = buf + wait_data(cur - buf);
+		check_stream();
+		if (cur >= end) break;
+		/* the lines before `cur` are never read again */
+		if ((size_t)(cur - buf) >= released + STREAM_CHUNK_SIZE) release(cur - buf);
+		/* if read a blank line, just skip it */
+		id_buf.clear();
+		value_buf.clear();
+		if (!parse_line(cur, end, y, id_buf, value_buf)) continue;
+
+		ret = new example_t();
+		ret->y = y;
+		ret->assign(id_buf.size(), id_buf.data(), value_buf.data());
+		return ret;
+	}
+	return nullptr;
+}
+
+std::vector<example_t*> data_reader::read_examples() {
+	example_t* single;
+	std::vector<example_t*> ret;
+
+	while( (single=read_an_example()) != nullptr) {
+		ret.push_back(single);
+	}
+
+	return ret;
+}
+
+void data_reader::read_range(size_t begin, size_t end, example_batch& batch) {
+	const char* p = buf + begin;
+	const char* e = buf + end;
+	target_t y = -1;
+
+	while (p < e) {
+		/* if read a blank line, just skip it */
+		if (!parse_line(p, e, y, batch.fea_id, batch.fea_value)) continue;
+		batch.y.push_back(y);
+		batch.row_ptr.push_back(batch.fea_id.size());
+	}
+}
+
+std::vector<size_t> data_reader::split(int n_threads) {
+	const size_t min_chunk = 1 << 20; /* do not bother to split less than 1MB to a thread */
+	size_t begin = cur - buf, pos;
+	std::vector<size_t> bound;
+
+	/* the size of a compressed file is known only after the decompression */
+	wait_data((size_t)-1);
+	if (n_threads <= 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+	n_threads = (int)std::max((size_t)1, std::min((size_t)n_threads, (buf_size - begin) / min_chunk));
+
+	/* split [begin, buf_size) into `n_threads` ranges, each range begins at the start of a line */
+	bound.resize(n_threads + 1);
+	bound[0] = begin;
+	bound[n_threads] = buf_size;
+	for (int i = 1; i < n_threads; i++) {
+		pos = begin + (buf_size - begin) / n_threads * i;
+		while (pos < buf_size && buf[pos-1] != '\n') pos++;
+		bound[i] = std::max(pos, bound[i-1]);
+	}
+	return bound;
+}
+
+int data_reader::plan_chunks(int n_threads) {
+	std::lock_guard<std::mutex> guard(chunk_mtx);
+
+	if (src == nullptr) {
+		/* a chunk for each worker */
+		chunk_bound = split(n_threads);
+		chunk_complete = true;
+		return chunk_bound.size() - 1;
+	}
+	/* the chunks are cut by `get_chunk` as the file is being decompressed */
+	if (n_threads <= 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+	chunk_bound.assign(1, cur - buf);
+	chunk_complete = false;
+	return n_threads;
+}
+
+void data_reader::set_chunks(const std::vector<size_t>& bound) {
+	std::lock_guard<std::mutex> guard(chunk_mtx);
+
+	chunk_bound = bound;
+	chunk_complete = true;
+}
+
+bool data_reader::get_chunk(int k, size_t& begin, size_t& end) {
+	std::lock_guard<std::mutex> guard(chunk_mtx);
+	size_t last, pos, avail;
+	const char* q;
+
+	/* cut the chunks up to the kth, each chunk ends after the first line break beyond `STREAM_CHUNK_SIZE` bytes */
+	while ((int)chunk_bound.size() <= k + 1 && !chunk_complete) {
+		last = chunk_bound.back();
+		pos = last + STREAM_CHUNK_SIZE - 1;
+		avail = wait_data(pos);
+		/* a broken file is not parsed any further */
+		if (has_stream_error()) {
+			chunk_complete = true;
+			return false;
+		}
+		q = (avail > pos) ? (const char*)memchr(buf + pos, '\n', avail - pos) : nullptr;
+		if (q != nullptr) {
+			chunk_bound.push_back(q - buf + 1);
+		} else {
+			/* `wait_data` only returns without a line break if the file is done */
+			if (avail > last) chunk_bound.push_back(avail);
+			chunk_complete = true;
+		}
+	}
+	if ((int)chunk_bound.size() <= k + 1) return false;
+
+	begin = chunk_bound[k];
+	end = chunk_bound[k+1];
+	/* the chunks may be given by `set_chunks` before they are decompressed */
+	if (src != nullptr && end > begin) {
+		wait_data(end - 1);
+		if (has_stream_error()) return false;
+	}
+	return true;
+}
+
+std::vector<size_t> data_reader::get_chunks() {
+	std::lock_guard<std::mutex> guard(chunk_mtx);
+	return chunk_bound;
+}
+
+void data_reader::release_chunk(int k) {
+	std::lock_guard<std::mutex> guard(chunk_mtx);
+
+	if (src == nullptr) return;
+	if ((int)chunk_released.size() <= k) chunk_released.resize(k + 1, 0);
+	chunk_released[k] = 1;
+	while (n_released < chunk_released.size() && chunk_released[n_released]) n_released++;
+	/* chunks are parsed out of order by the workers, only the prefix which is all parsed can be dropped */
+	release(chunk_bound[n_released]);
+}
+
+bool data_reader::next_line(size_t& pos, size_t end, target_t& y, std::vector<int>& id, std::vector<feature_t>& value) {
+	const char* p = buf + pos;
+	const char* e = buf + end;
+	bool found = false;
+
+	while (p < e && !found) {
+		id.clear();
+		value.clear();
+		/* if read a blank line, just skip it */
+		found = parse_line(p, e, y, id, value);
+	}
+	pos = p - buf;
+	return found;
+}
+
+void data_reader::read_examples(example_batch& batch, int n_threads) {
+	std::vector<std::vector<example_batch> > worker_local;
+	std::vector<example_batch> local;
+	std::vector<std::thread> threads;
+	std::vector<size_t> row_offset, nnz_offset;
+	int n_chunks;
+
+	n_threads = plan_chunks(n_threads);
+
+	/* parse each chunk to a local batch of its worker */
+	worker_local.resize(n_threads);
+	auto read_chunks = [&](int w) {
+		size_t begin, end;
+		for (int k = w; get_chunk(k, begin, end); k += n_threads) {
+			worker_local[w].push_back(example_batch());
+			read_range(begin, end, worker_local[w].back());
+			release_chunk(k);
+		}
+	};
+	for (int i = 1; i < n_threads; i++) threads.push_back(std::thread(read_chunks, i));
+	read_chunks(0);
+	std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
+	threads.clear();
+	check_stream();
+
+	/* the kth chunk is the (k/n)th local batch of worker k%n */
+	n_chunks = get_chunks().size() - 1;
+	local.resize(n_chunks);
+	for (int k = 0; k < n_chunks; k++) std::swap(local[k], worker_local[k % n_threads][k / n_threads]);
+	worker_local.clear();
+
+	/* stitch the local batches in order, so example ids are the same as a serial read */
+	batch.clear();
+	row_offset.assign(n_chunks + 1, 0);
+	nnz_offset.assign(n_chunks + 1, 0);
+	for (int i = 0; i < n_chunks; i++) {
+		row_offset[i+1] = row_offset[i] + local[i].get_n_examples();
+		nnz_offset[i+1] = nnz_offset[i] + local[i].get_nnz();
+	}
+	batch.y.resize(row_offset[n_chunks]);
+	batch.row_ptr.resize(row_offset[n_chunks] + 1);
+	batch.fea_id.resize(nnz_offset[n_chunks]);
+	batch.fea_value.resize(nnz_offset[n_chunks]);
+	n_threads = std::min(n_threads, n_chunks);
+	for (int w = 0; w < n_threads; w++) {
+		threads.push_back(std::thread([&, w]() {
+			for (int i = w; i < n_chunks; i += n_threads) {
+				example_batch& l = local[i];
+				std::copy(l.y.begin(), l.y.end(), batch.y.begin() + row_offset[i]);
+				for (int r = 0; r < l.get_n_examples(); r++)
+					batch.row_ptr[row_offset[i]+r+1] = nnz_offset[i] + l.row_ptr[r+1];
+				std::copy(l.fea_id.begin(), l.fea_id.end(), batch.fea_id.begin() + nnz_offset[i]);
+				std::copy(l.fea_value.begin(), l.fea_value.end(), batch.fea_value.begin() + nnz_offset[i]);
+				/* release the local batch as soon as possible */
+				l = example_batch();
+			}
+		}));
+	}
+	std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
+
+	/* every chunk has been read, so is the whole file */
+	end = buf + buf_size;
+	cur = end;
+}
+
+dataset::dataset() {
+	is_init = false;
+	x = nullptr;
+	size = nullptr;
+	valid_features = nullptr;
+	y = nullptr;
+	weight = nullptr;
+	is_cate = nullptr;
+	cache_buf = nullptr;
+	x_data = nullptr;
+	cx = nullptr;
+	is_dense = nullptr;
+	dense_value_data = nullptr;
+	pool = nullptr;
+	spill_buf = nullptr;
+	bin = nullptr;
+	row_start = nullptr;
+	hash_buckets = 0;
+}
+
+dataset::dataset(int n_classes, int n_features, float* weight) {
+	hash_buckets = 0;
+	init(n_classes, n_features, weight);
+}
+
+void dataset::set_feature_hash(int n_buckets) {
+	hash_buckets = n_buckets;
+}
+
+int dataset::get_feature_hash() {
+	return hash_buckets;
+}
+
+dataset::~dataset() {
+	if (cache_buf != nullptr) {
+		munmap(cache_buf, cache_size);
+		cache_buf = nullptr;
+	}
+	if (x_data != nullptr) {
+		delete[] x_data;
+		x_data = nullptr;
+	}
+	if (cx != nullptr) {
+		delete[] cx;
+		cx = nullptr;
+	}
+	if (pool != nullptr) {
+		delete pool;
+		pool = nullptr;
+	}
+	if (spill_buf != nullptr) {
+		munmap(spill_buf, spill_size);
+		unlink(spill_path.c_str());
+		spill_buf = nullptr;
+	}
+	if (dense_value_data != nullptr) {
+		delete[] dense_value_data;
+		delete[] order_data;
+		dense_value_data = nullptr;
+	}
+	if (is_dense != nullptr) {
+		delete[] is_dense;
+		delete[] dense_value;
+		delete[] order;
+		is_dense = nullptr;
+	}
+	if (row_start != nullptr) {
+		delete[] row_start;
+		delete[] row_feature;
+		delete[] row_value;
+		row_start = nullptr;
+	}
+	if (x != nullptr) {
+		delete[] x;
+		x = nullptr;
+	}
+	if (size != nullptr) {
+		delete[] size;
+		size = nullptr;
+	}
+	if (valid_features != nullptr) {
+		delete[] valid_features;
+		valid_features = nullptr;
+	}
+	if (y != nullptr) {
+		delete[] y;
+		y = nullptr;
+	}
+	if (is_cate != nullptr) {
+		delete[] is_cate;	
+		is_cate = nullptr;
+	}
+	if (weight != nullptr) {
+		delete[] weight;
+		weight = nullptr;
+	}
+	if (bin != nullptr) {
+		for (int f = 0; f < n_features; f++) delete[] cut[f];
+		delete[] bin_data;
+		delete[] bin;
+		delete[] cut;
+		delete[] n_bins;
+		delete[] zero_bin;
+		bin = nullptr;
+	}
+}
+
+void dataset::init(int n_classes, int n_features, float* weight) {
+	this->n_classes = n_classes;
+	this->n_features = n_features;
+	this->x = new ev_pair_t*[this->n_features];
+	this->y = nullptr;
+	this->size = new int[this->n_features]();
+	this->valid_features = new int[this->n_features]();
+	this->n_valid = 0;
+	/* copy weight vector to dataset */
+	this->weight = new float[this->n_classes];
+	memcpy(this->weight, weight, sizeof(float)*this->n_classes);
+
+	this->is_cate = new bool[this->n_features]();
+	this->cache_buf = nullptr;
+	this->cache_size = 0;
+	this->bin_data = nullptr;
+	this->x_data = nullptr;
+	this->cx = nullptr;
+	this->is_dense = new bool[this->n_features]();
+	this->dense_value = new feature_t*[this->n_features]();
+	this->order = new int*[this->n_features]();
+	this->dense_value_data = nullptr;
+	this->order_data = nullptr;
+	this->pool = nullptr;
+	this->spill_buf = nullptr;
+	this->spill_size = 0;
+	this->bin = nullptr;
+	this->cut = nullptr;
+	this->n_bins = nullptr;
+	this->zero_bin = nullptr;
+	this->row_start = nullptr;
+	this->row_feature = nullptr;
+	this->row_value = nullptr;
+	this->is_init = true;
+}
+
+void dataset::load_data(const std::string& filename, const learn_mode mode, int n_threads, const data_format format) {
+	data_reader* dr = new data_reader(filename, n_features, mode, format);
+	dr->set_feature_hash(hash_buckets);
+	std::vector<size_t> bound;
+	std::vector<std::thread> threads;
+	std::vector<std::vector<int> > worker_rows;
+	int n_sort_threads = n_threads;
+	int** fea_count; 	/* fea_count[w][f] number of non-zero entries of feature `f` in the chunks of worker `w` */
+	int* row_count; 	/* number of examples in each chunk */
+	int n_chunks;
+	ev_pair_t* te; /* store ev_pair*/
+	int tot_size; /* total size in the dataset */
+	m_timer* t = new m_timer();
+
+	this->mode = mode;
+
+	if (!is_init) {
+		std::cerr << "Please init the dataset first" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	/* the chunks of the input file are handed to the same worker in both passes, worker `w` handles 
+	 * chunk `w`, `w`+n, `w`+2n ..., a compressed file has more chunks than workers (see `data_reader::plan_chunks`) */
+	if (mode == TRAIN && meta_filename == filename && meta_format == format) {
+		/* `load_data_meta` has counted the same chunks */
+		dr->set_chunks(meta_bound);
+		n_threads = meta_fea_count.size();
+	} else {
+		n_threads = dr->plan_chunks(n_threads);
+	}
+	fea_count = new int*[n_threads];
+	for (int i = 0; i < n_threads; i++) fea_count[i] = new int[n_features]();
+
+	t->tic("Loading data from file "+filename+" ...");
+	if (mode == TRAIN && meta_filename == filename && meta_format == format) {
+		bound = meta_bound;
+		n_chunks = bound.size() - 1;
+		row_count = new int[n_chunks > 0 ? n_chunks : 1]();
+		std::copy(meta_row_count.begin(), meta_row_count.end(), row_count);
+		for (int i = 0; i < n_threads; i++) {
+			std::copy(meta_fea_count[i].begin(), meta_fea_count[i].end(), fea_count[i]);
+		}
+	} else {
+		/* pass one: count examples and non-zero entries of each feature, a compressed file is 
+		 * counted while it is being decompressed */
+		worker_rows.resize(n_threads);
+		auto count_chunks = [&](int w) {
+			std::vector<int> id;
+			std::vector<feature_t> value;
+			size_t pos, end;
+			target_t label;
+			for (int k = w; dr->get_chunk(k, pos, end); k += n_threads) {
+				int rows = 0;
+				while (dr->next_line(pos, end, label, id, value)) {
+					for (size_t j = 0; j < id.size(); j++) fea_count[w][id[j]]++;
+					rows++;
+				}
+				worker_rows[w].push_back(rows);
+			}
+		};
+		for (int i = 1; i < n_threads; i++) threads.push_back(std::thread(count_chunks, i));
+		count_chunks(0);
+		std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
+		threads.clear();
+		dr->check_stream();
+
+		bound = dr->get_chunks();
+		n_chunks = bound.size() - 1;
+		row_count = new int[n_chunks > 0 ? n_chunks : 1]();
+		for (int k = 0; k < n_chunks; k++) row_count[k] = worker_rows[k % n_threads][k / n_threads];
+		/* every entry is parsed once so far */
+		dr->print_hash_stats();
+	}
+	/* the counts are not needed any more */
+	meta_filename.clear();
+	meta_bound.clear();
+	meta_row_count.clear();
+	meta_fea_count.clear();
+
+	/* `size` is known, so every entry has its final place: feature `f` of the wth worker starts
+	 * right after the same feature of the previous workers, which keeps `ex_id` ascending in a column 
+	 * if every worker has only one chunk */
+	n_examples = 0;
+	for (int k = 0; k < n_chunks; k++) {
+		int c = row_count[k];
+		row_count[k] = n_examples;
+		n_examples += c;
+	}
+	tot_size = 0;
+	for (int f = 0; f < n_features; f++) {
+		for (int i = 0; i < n_threads; i++) {
+			int c = fea_count[i][f];
+			fea_count[i][f] = tot_size;
+			tot_size += c;
+			size[f] += c;
+		}
+	}
+	if (!spill_path.empty()) {
+		/* the columns live in a shared file mapping, pages can be written back and dropped by the OS */
+		int fd = open(spill_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		spill_size = sizeof(ev_pair_t)*(tot_size > 0 ? tot_size : 1);
+		if (fd < 0 || ftruncate(fd, spill_size) < 0) {
+			std::cerr << "Can not create file " << spill_path << " ." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		spill_buf = (char*)mmap(nullptr, spill_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (spill_buf == MAP_FAILED) {
+			std::cerr << "Can not map file " << spill_path << " into memory." << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		te = (ev_pair_t*)spill_buf;
+	} else {
+		te = new ev_pair_t[tot_size > 0 ? tot_size : 1];
+	}
+	/* test mode does not need y array*/
+	if (mode != TEST) {
+		y = new target_t[n_examples > 0 ? n_examples : 1];
+	}
+
+	/* pass two: scatter each entry straight into its slot */
+	auto scatter_chunks = [&](int w) {
+		std::vector<int> id;
+		std::vector<feature_t> value;
+		size_t pos, end;
+		int ex_id, k;
+		target_t label;
+		for (int c = w; dr->get_chunk(c, pos, end); c += n_threads) {
+			ex_id = row_count[c];
+			while (dr->next_line(pos, end, label, id, value)) {
+				/* test mode does not has label */
+				if (mode != TEST) y[ex_id] = label;
+				for (size_t j = 0; j < id.size(); j++) {
+					k = fea_count[w][id[j]]++;
+					te[k].set(ex_id, value[j]);
+				}
+				ex_id++;
+			}
+			/* the last pass over the chunk */
+			dr->release_chunk(c);
+		}
+	};
+	for (int i = 1; i < n_threads; i++) threads.push_back(std::thread(scatter_chunks, i));
+	scatter_chunks(0);
+	std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
+	threads.clear();
+	dr->check_stream();
+	delete dr;
+	t->toc("Done.");
+
+	/* generate dataset */
+	t->tic("Generating dataset ...");
+
+	if (mode != TEST) {
+		/* change labels if they are not between 0 and n_classes-1, the map is kept for `append` */
+		label_map.clear();
+		bool *label_mask = new bool[n_classes];
+		int l;
+		/* initalize the label_mask to false */
+		for (int c = 0; c < n_classes; c++) label_mask[c] = false;
+		/* set label_mask entry to true it there exist y in datasets which is between 0 and n_classes-1 */
+		for (int i = 0; i < n_examples; i++) {
+			l = y[i];
+			if (l < 0 || l >= n_classes) {
+				label_map[l] = -1; // -1 is no meaning just a place holder
+			} else {
+				label_mask[l] = true;
+			}
+		}
+		l = -1;
+		for (auto it = label_map.begin(); it != label_map.end(); it++) {
+			/* find an avaiable label value(between 0 and n_classes-1) */
+			while (label_mask[++l] == true);
+			label_mask[l] = true;
+			it->second = l;
+		}
+		/* change labels to between 0 and n_classes-1 */
+		for (int i = 0; i < n_examples; i++) {
+			if (y[i] < 0 || y[i] >= n_classes) {
+				y[i] = label_map[y[i]];
+			}
+		}
+		if (label_mask != nullptr) {
+			delete[] label_mask;
+			label_mask = nullptr;
+		}
+	}
+
+	int t_sum = 0;
+	x[0] = te;
+	if (spill_buf == nullptr) x_data = te;
+	for (int i = 1; i < n_features; i++) {
+		t_sum += size[i-1];
+		x[i] = x[0] + t_sum;	
+	}
+	t->toc("Done.");
+
+	/* entries are already grouped by feature, so each column only needs to be sorted by value */
+	t->tic("Sorting columns ...");
+	sort(n_sort_threads, n_chunks > n_threads);
+	t->toc("Done.");
+
+	/** find valid features **/
+	for (int i = 0; i < n_features; i++) {
+		if (this->size[i] > 0) {
+			this->valid_features[this->n_valid++] = i;
+		}
+	}
+
+	if (spill_buf == nullptr) build_dense(n_sort_threads);
+
+	/* free space */
+	for (int i = 0; i < n_threads; i++) delete[] fea_count[i];
+	delete[] fea_count;
+	delete[] row_count;
+}
+
+void dataset::load_data_meta(const std::string& filename, int n_threads, const data_format format) {
+	data_reader* dr = new data_reader(filename, 0, TRAIN, format);
+	dr->set_feature_hash(hash_buckets);
+	std::vector<std::thread> threads;
+	std::vector<std::set<int> > range_labels;
+	std::vector<std::vector<int> > worker_rows;
+	std::set<int> all_labels;
+	int max_id = -1;
+	m_timer* t = new m_timer();
+
+	t->tic("Scanning file "+filename+" ...");
+	n_threads = dr->plan_chunks(n_threads);
+	meta_fea_count.assign(n_threads, std::vector<int>());
+	worker_rows.resize(n_threads);
+	range_labels.resize(n_threads);
+
+	/* same chunks as pass one of `load_data`, with the number of features unknown */
+	auto scan_chunks = [&](int w) {
+		std::vector<int> id;
+		std::vector<feature_t> value;
+		std::vector<int>& count = meta_fea_count[w];
+		size_t pos, end;
+		target_t label;
+		for (int k = w; dr->get_chunk(k, pos, end); k += n_threads) {
+			int rows = 0;
+			while (dr->next_line(pos, end, label, id, value)) {
+				for (size_t j = 0; j < id.size(); j++) {
+					if (id[j] >= (int)count.size()) count.resize(id[j]+1, 0);
+					count[id[j]]++;
+				}
+				range_labels[w].insert(label);
+				rows++;
+			}
+			worker_rows[w].push_back(rows);
+		}
+	};
+	for (int i = 1; i < n_threads; i++) threads.push_back(std::thread(scan_chunks, i));
+	scan_chunks(0);
+	std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
+	dr->check_stream();
+	meta_bound = dr->get_chunks();
+	dr->print_hash_stats();
+	delete dr;
+
+	meta_row_count.resize(meta_bound.size() - 1);
+	for (size_t k = 0; k < meta_row_count.size(); k++) meta_row_count[k] = worker_rows[k % n_threads][k / n_threads];
+	n_examples = 0;
+	for (size_t k = 0; k < meta_row_count.size(); k++) n_examples += meta_row_count[k];
+	for (int i = 0; i < n_threads; i++) {
+		max_id = std::max(max_id, (int)meta_fea_count[i].size() - 1);
+		all_labels.insert(range_labels[i].begin(), range_labels[i].end());
+	}
+	labels.assign(all_labels.begin(), all_labels.end());
+	t->toc("Done.");
+
+	if (is_init) {
+		/* check the given parameters before anything is loaded */
+		if (max_id >= n_features) {
+			std::cerr << "input file " << filename << " has feature id " << max_id << ", but `n_features` is " << n_features << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		if ((int)labels.size() > n_classes) {
+			std::cerr << "input file " << filename << " has " << labels.size() << " labels, but `n_classes` is " << n_classes << std::endl;
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		/* hashed ids may leave the last buckets empty */
+		n_features = hash_buckets > 0 ? hash_buckets : max_id + 1;
+		n_classes = labels.size();
+	}
+	meta_filename = filename;
+	meta_format = format;
+	delete t;
+}
+
+void dataset::append(std::vector<example_t*>& examples, int n_threads) {
+	example_batch batch(examples);
+	append(batch, n_threads);
+}
+
+void dataset::append(example_batch& examples, int n_threads) {
+	std::vector<std::thread> threads;
+	std::vector<int> fea_order;
+	std::atomic<int> next(0);
+	int n_new = examples.get_n_examples(), f, l;
+	size_t nnz = examples.get_nnz(), tot_size;
+	size_t* new_offset; 	/* new entries of feature `f` are new_entry[new_offset[f], new_offset[f+1]) */
+	size_t* col_offset; 	/* merged column of feature `f` starts at data[col_offset[f]] */
+	ev_pair_t *new_entry, *data;
+	target_t* new_y;
+	bool* label_mask;
+	m_timer* t;
+
+	if (!is_init || mode != TRAIN) {
+		std::cerr << "Please load a training set before appending examples" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	if (cx != nullptr || pool != nullptr || bin != nullptr) {
+		std::cerr << "Can not append examples to a compressed, out-of-core or binned dataset" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	if (n_new == 0) return;
+
+	t = new m_timer();
+	t->tic("Appending examples ...");
+	/* change labels as `load_data` did, a label which is not seen before can only take a free class */
+	label_mask = new bool[n_classes]();
+	for (auto it = label_map.begin(); it != label_map.end(); it++) label_mask[it->second] = true;
+	new_y = new target_t[n_examples + n_new];
+	memcpy(new_y, y, sizeof(target_t)*n_examples);
+	for (int i = 0; i < n_new; i++) {
+		l = examples.y[i];
+		if (label_map.count(l) > 0) {
+			l = label_map[l];
+		} else if (l < 0 || l >= n_classes || label_mask[l]) {
+			std::cerr << "label " << l << " of the appended examples does not match the labels of the training set" << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		new_y[n_examples + i] = l;
+	}
+	delete[] label_mask;
+
+	/* group the new entries by feature, they are in `ex_id` order within a feature */
+	new_offset = new size_t[n_features + 1]();
+	for (size_t j = 0; j < nnz; j++) {
+		f = examples.fea_id[j];
+		if (f < 0 || f >= n_features) {
+			std::cerr << "appended feature id " << f << " exceed `n_features` " << n_features << std::endl;
+			exit(EXIT_FAILURE);
+		}
+		new_offset[f+1]++;
+	}
+	for (f = 0; f < n_features; f++) new_offset[f+1] += new_offset[f];
+	new_entry = new ev_pair_t[nnz > 0 ? nnz : 1];
+	{
+		std::vector<size_t> pos(new_offset, new_offset + n_features);
+		for (int i = 0; i < n_new; i++) {
+			for (size_t j = examples.row_ptr[i]; j < examples.row_ptr[i+1]; j++) {
+				new_entry[pos[examples.fea_id[j]]++].set(n_examples + i, examples.fea_value[j]);
+			}
+		}
+	}
 
-	fea_id[nnz] = id;
-	fea_value[nnz] = value;
+	/* the merged columns are laid out as `load_data` does */
+	col_offset = new size_t[n_features + 1];
+	tot_size = 0;
+	for (f = 0; f < n_features; f++) {
+		col_offset[f] = tot_size;
+		tot_size += size[f] + (new_offset[f+1] - new_offset[f]);
+		if (new_offset[f+1] > new_offset[f]) fea_order.push_back(f);
+	}
+	col_offset[n_features] = tot_size;
+	data = new ev_pair_t[tot_size > 0 ? tot_size : 1];
+	/* columns without any new entry are only copied */
+	for (f = 0; f < n_features; f++) {
+		if (new_offset[f+1] == new_offset[f]) fea_order.push_back(f);
+	}
 
-	nnz++;
+	if (n_threads <= 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+	n_threads = std::max(1, std::min(n_threads, n_features));
+	auto merge_worker = [&]() {
+		std::vector<ev_pair_t> tmp;
+		ev_pair_t buf[COLUMN_BLOCK_SIZE];
+		const ev_pair_t* blk;
+		ev_pair_t *a, *out;
+		int i, f, n, m, b, j, k;
+		while ((i = next++) < n_features) {
+			f = fea_order[i];
+			a = new_entry + new_offset[f];
+			m = new_offset[f+1] - new_offset[f];
+			out = data + col_offset[f];
+			/* sort the new entries, which are in `ex_id` order, so ties stay in `ex_id` order */
+			if ((int)tmp.size() < m) tmp.resize(m);
+			sort_column(a, m, tmp.data());
+			/* merge with the sorted column by the same key as `sort_column`, the old examples go first on ties since their ids are smaller */
+			k = j = 0;
+			for (b = 0; b < get_n_blocks(f); b++) {
+				blk = get_block(f, b, buf, n);
+				for (int e = 0; e < n; e++) {
+					while (j < m && radix_key(a[j].fea_value) < radix_key(blk[e].fea_value)) out[k++] = a[j++];
+					out[k++] = blk[e];
+				}
+			}
+			while (j < m) out[k++] = a[j++];
+		}
+	};
+	for (int i = 1; i < n_threads; i++) threads.push_back(std::thread(merge_worker));
+	merge_worker();
+	std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
+	delete[] new_entry;
+	delete[] new_offset;
+
+	/* release the old storage, the merged columns are always in memory */
+	release_columns();
+	x_data = data;
+	delete[] y;
+	y = new_y;
+
+	/* grow `size` and `valid_features` in place */
+	n_examples += n_new;
+	n_valid = 0;
+	for (f = 0; f < n_features; f++) {
+		size[f] = col_offset[f+1] - col_offset[f];
+		x[f] = data + col_offset[f];
+		dense_value[f] = nullptr;
+		order[f] = nullptr;
+		if (size[f] > 0) valid_features[n_valid++] = f;
+	}
+	delete[] col_offset;
+
+	/* the rows were built from the old columns */
+	if (row_start != nullptr) {
+		delete[] row_start;
+		delete[] row_feature;
+		delete[] row_value;
+		row_start = nullptr;
+		row_feature = nullptr;
+		row_value = nullptr;
+	}
+
+	build_dense(n_threads);
+	t->toc("Done.");
+	delete t;
 }
 
-void example_t::debug() {
-	if (y != -1) {
-		std::cout << "Example Label: " << y << std::endl;
+void dataset::release_columns() {
+	if (cache_buf != nullptr) {
+		munmap(cache_buf, cache_size);
+		cache_buf = nullptr;
 	}
-	std::cout << "Features: " << std::endl;
-	for (int i = 0; i < nnz; i++) {
-		std::cout << fea_id[i] << ":" << fea_value[i] << " ";
+	if (x_data != nullptr) {
+		delete[] x_data;
+		x_data = nullptr;
+	}
+	if (spill_buf != nullptr) {
+		munmap(spill_buf, spill_size);
+		unlink(spill_path.c_str());
+		spill_buf = nullptr;
+		spill_path.clear();
+	}
+	if (dense_value_data != nullptr) {
+		delete[] dense_value_data;
+		delete[] order_data;
+		dense_value_data = nullptr;
+		order_data = nullptr;
 	}
-	std::cout << std::endl << std::endl;
 }
 
-data_reader::data_reader(const std::string& filename, int n_features, const learn_mode mode) {
-	ifs.open(filename.c_str(), std::ios::binary);
-	if (!ifs.is_open()) {
-		std::cerr << "Can not open file " << filename << " ." << std::endl;
+void dataset::build_dense(int n_threads) {
+	std::vector<std::thread> threads;
+	std::atomic<int> next(0);
+	ev_pair_t* packed;
+	size_t n_dense = 0, offset = 0;
+
+	for (int f = 0; f < n_features; f++) {
+		is_dense[f] = (n_examples > 0 && size[f] == n_examples);
+		if (is_dense[f]) n_dense++;
+	}
+	if (n_dense == 0) return;
+
+	dense_value_data = new feature_t[n_dense*n_examples];
+	order_data = new int[n_dense*n_examples];
+	for (int f = 0; f < n_features; f++) {
+		if (!is_dense[f]) continue;
+		dense_value[f] = dense_value_data + offset;
+		order[f] = order_data + offset;
+		offset += n_examples;
+	}
+
+	if (n_threads <= 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+	auto dense_worker = [&]() {
+		int f;
+		while ((f = next++) < n_features) {
+			if (!is_dense[f]) continue;
+			/* the column is sorted, so its example ids are the sorted order */
+			for (int j = 0; j < n_examples; j++) {
+				order[f][j] = x[f][j].ex_id;
+				dense_value[f][x[f][j].ex_id] = x[f][j].fea_value;
+			}
+		}
+	};
+	for (int i = 1; i < n_threads; i++) threads.push_back(std::thread(dense_worker));
+	dense_worker();
+	std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
+
+	/* pack the sparse columns, a mapped cache file is left as it is */
+	if (x_data != nullptr) {
+		offset = 0;
+		for (int f = 0; f < n_features; f++) {
+			if (!is_dense[f]) offset += size[f];
+		}
+		packed = new ev_pair_t[offset > 0 ? offset : 1];
+		offset = 0;
+		for (int f = 0; f < n_features; f++) {
+			if (is_dense[f]) continue;
+			memcpy(packed + offset, x[f], sizeof(ev_pair_t)*size[f]);
+			x[f] = packed + offset;
+			offset += size[f];
+		}
+		delete[] x_data;
+		x_data = packed;
+	}
+	for (int f = 0; f < n_features; f++) {
+		if (is_dense[f]) x[f] = nullptr;
+	}
+}
+
+void dataset::build_bins(int max_bins, int n_threads) {
+	std::vector<std::thread> threads;
+	std::atomic<int> next(0);
+	size_t offset = 0;
+
+	if (max_bins < 2 || max_bins > 256) {
+		std::cerr << "`max_bins` must between 2 and 256" << std::endl;
 		exit(EXIT_FAILURE);
 	}
-	this->n_features = n_features;
-	this->mode = mode;
+	if (bin != nullptr) return;
+
+	for (int f = 0; f < n_features; f++) offset += size[f];
+	bin_data = new unsigned char[offset > 0 ? offset : 1];
+	bin = new unsigned char*[n_features];
+	cut = new feature_t*[n_features]();
+	n_bins = new int[n_features];
+	zero_bin = new int[n_features];
+	offset = 0;
+	for (int f = 0; f < n_features; f++) {
+		bin[f] = bin_data + offset;
+		offset += size[f];
+	}
+
+	if (n_threads <= 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+	auto bin_worker = [&]() {
+		int f;
+		while ((f = next++) < n_features) build_feature_bins(f, max_bins);
+	};
+	for (int i = 1; i < n_threads; i++) threads.push_back(std::thread(bin_worker));
+	bin_worker();
+	std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
 }
 
-data_reader::~data_reader() {
-	if (ifs.is_open()) {
-		ifs.close();
+void dataset::build_feature_bins(int f, int max_bins) {
+	const ev_pair_t* col;
+	ev_pair_t* buf = new ev_pair_t[COLUMN_BLOCK_SIZE];
+	std::vector<feature_t> value, cuts;
+	std::vector<int> count;
+	int n_blocks = get_n_blocks(f), n_zero = n_examples - size[f], n, j, b, k;
+	double per_bin, acc, mid;
+
+	/* distinct values of the column (which is sorted) and their counts, the implicit zeros are merged in place */
+	for (k = 0; k < n_blocks; k++) {
+		col = get_block(f, k, buf, n);
+		for (j = 0; j < n; j++) {
+			if (n_zero > 0 && col[j].fea_value >= 0 && (value.empty() || value.back() < 0)) {
+				value.push_back(0);
+				count.push_back(0);
+			}
+			if (value.empty() || value.back() != col[j].fea_value) {
+				value.push_back(col[j].fea_value);
+				count.push_back(0);
+			}
+			count.back()++;
+		}
+	}
+	if (n_zero > 0) {
+		if (value.empty() || value.back() < 0) {
+			value.push_back(0);
+			count.push_back(0);
+		}
+		for (j = 0; j < (int)value.size(); j++) {
+			if (value[j] == 0) count[j] += n_zero;
+		}
+	}
+
+	/* cut between every pair of distinct values if there are few, otherwise cut at quantiles */
+	per_bin = (double)n_examples / max_bins;
+	acc = 0;
+	for (j = 0; j + 1 < (int)value.size(); j++) {
+		acc += count[j];
+		if ((int)value.size() <= max_bins || (acc >= per_bin*(cuts.size()+1) && (int)cuts.size() < max_bins-1)) {
+			/* the cut must be in [value[j], value[j+1]) so that value[j+1] is not in this bin */
+			mid = 0.5*((double)value[j] + (double)value[j+1]);
+			cuts.push_back((feature_t)mid >= value[j+1] ? value[j] : (feature_t)mid);
+		}
 	}
+
+	n_bins[f] = cuts.size() + 1;
+	cut[f] = new feature_t[cuts.size() > 0 ? cuts.size() : 1];
+	std::copy(cuts.begin(), cuts.end(), cut[f]);
+
+	/* bin of value `v` is the number of cut points less than `v` */
+	b = 0;
+	for (k = 0; k < n_blocks; k++) {
+		col = get_block(f, k, buf, n);
+		for (j = 0; j < n; j++) {
+			while (b < (int)cuts.size() && col[j].fea_value > cuts[b]) b++;
+			bin[f][k*COLUMN_BLOCK_SIZE + j] = (unsigned char)b;
+		}
+	}
+	zero_bin[f] = std::lower_bound(cuts.begin(), cuts.end(), (feature_t)0) - cuts.begin();
+
+	delete[] buf;
 }
 
-example_t* data_reader::read_an_example() {
-	example_t* ret;
-	std::string line, t_str;
-	int p_pos, c_pos, feature_id;
-	feature_t feature_value;
+bool dataset::is_binned() {
+	return bin != nullptr;
+}
+
+void dataset::build_rows() {
+	ev_pair_t* buf;
+	const ev_pair_t* e;
+	int* pos;
+	int n;
+	size_t nnz = 0;
+	m_timer* t;
 
-	if (ifs.eof()) {
-		return nullptr;
+	if (row_start != nullptr || cx != nullptr || pool != nullptr) return;
+	t = new m_timer();
+	t->tic("Building rows ...");
+	for (int f = 0; f < n_features; f++) {
+		if (!is_dense[f]) nnz += size[f];
 	}
+	row_start = new int[n_examples+1]();
+	row_feature = new int[nnz > 0 ? nnz : 1];
+	row_value = new feature_t[nnz > 0 ? nnz : 1];
+	buf = new ev_pair_t[COLUMN_BLOCK_SIZE];
 
-	ret = new example_t();
-	
-	if (mode != TEST) {
-		/* read label */
-		ifs >> ret->y;
-		//ret->y--; //!!!!!!!!!!!!!!!!!!!!
-		p_pos = 0; getline(ifs, line);
-		c_pos = line.find(' ', 0);
-	} else {
-		p_pos = 0; c_pos = 0;
-		getline(ifs, line);
+	/* count the entries of each example, then fill them feature by feature so they are in ascending feature id */
+	for (int f = 0; f < n_features; f++) {
+		if (is_dense[f]) continue;
+		for (int b = 0; b < get_n_blocks(f); b++) {
+			e = get_block(f, b, buf, n);
+			for (int j = 0; j < n; j++) row_start[e[j].ex_id+1]++;
+		}
+	}
+	for (int i = 0; i < n_examples; i++) row_start[i+1] += row_start[i];
+	pos = new int[n_examples > 0 ? n_examples : 1];
+	memcpy(pos, row_start, sizeof(int)*n_examples);
+	for (int f = 0; f < n_features; f++) {
+		if (is_dense[f]) continue;
+		for (int b = 0; b < get_n_blocks(f); b++) {
+			e = get_block(f, b, buf, n);
+			for (int j = 0; j < n; j++) {
+				row_feature[pos[e[j].ex_id]] = f;
+				row_value[pos[e[j].ex_id]++] = e[j].fea_value;
+			}
+		}
 	}
+	delete[] pos;
+	delete[] buf;
+	t->toc("Done.");
+	delete t;
+}
 
-	if (line.length() < 1) return nullptr;
-	
-	while (p_pos <= c_pos) {
-		p_pos = c_pos + 1;
-		c_pos = line.find(':', p_pos);
-		if (c_pos == -1) break;
-		t_str = line.substr(p_pos, c_pos - p_pos);
-		// libsvm format `feature_id` start from 1, we set it to start with 0
-		feature_id = atoi(t_str.c_str()) - 1;
+bool dataset::has_rows() {
+	return row_start != nullptr;
+}
 
-		p_pos = c_pos + 1;
-		c_pos = line.find(' ', p_pos);
-		feature_value = atof(line.substr(p_pos, c_pos - p_pos).c_str());
+bool dataset::lookup(int ex_id, int f, feature_t& v) {
+	const int *begin, *end, *it;
 
-		if (feature_id >= n_features) {
-			std::cerr << "input file feature id " << feature_id << " exceed `n_features` " << n_features << std::endl;
+	if (is_dense[f]) {
+		v = dense_value[f][ex_id];
+		return true;
+	}
+	begin = row_feature + row_start[ex_id];
+	end = row_feature + row_start[ex_id+1];
+	it = std::lower_bound(begin, end, f);
+	if (it == end || *it != f) return false;
+	v = row_value[it - row_feature];
+	return true;
+}
+
+double dataset::get_avg_row_size() {
+	return n_examples > 0 && row_start != nullptr ? (double)row_start[n_examples] / n_examples : 0.0;
+}
+
+void dataset::set_categorical(const std::vector<int>& features) {
+	ev_pair_t* buf = new ev_pair_t[COLUMN_BLOCK_SIZE];
+	const ev_pair_t* col;
+	feature_t v;
+	int n;
+
+	memset(is_cate, 0, sizeof(bool)*n_features);
+	for (int i = 0; i < (int)features.size(); i++) {
+		if (features[i] < 0 || features[i] >= n_features) {
+			std::cerr << "Categorical feature " << features[i] << " is out of range [0, " << n_features << ")" << std::endl;
 			exit(EXIT_FAILURE);
 		}
+		/* a category id indexes the bit set of a split */
+		for (int b = 0; b < get_n_blocks(features[i]); b++) {
+			col = get_block(features[i], b, buf, n);
+			for (int j = 0; j < n; j++) {
+				v = col[j].fea_value;
+				if (!(v >= 0 && v < MAX_CATEGORIES) || v != (int)v) {
+					std::cerr << "Categorical feature " << features[i] << " has value " << v 
+						<< ", which is not a category id in [0, " << MAX_CATEGORIES << ")" << std::endl;
+					exit(EXIT_FAILURE);
+				}
+			}
+		}
+		is_cate[features[i]] = true;
+	}
+	delete[] buf;
+}
 
-		ret->push_back(feature_id, feature_value);
+void dataset::compress(int n_threads) {
+	std::vector<std::thread> threads;
+	std::atomic<int> next(0);
+	size_t before = 0, after = 0;
+	m_timer* t = new m_timer();
+
+	if (cx != nullptr) return;
+	if (pool != nullptr) {
+		std::cerr << "Can not compress an out-of-core dataset" << std::endl;
+		exit(EXIT_FAILURE);
 	}
 
-	/* if read a blank line, just skip it */
-	if (ret->nnz == 0) {
-		return nullptr;
+	t->tic("Compressing columns ...");
+	cx = new compressed_column[n_features];
+	if (n_threads <= 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+	auto compress_worker = [&]() {
+		int f;
+		while ((f = next++) < n_features) {
+			/* dense columns are left as they are */
+			if (!is_dense[f]) cx[f].encode(x[f], size[f]);
+		}
+	};
+	for (int i = 1; i < n_threads; i++) threads.push_back(std::thread(compress_worker));
+	compress_worker();
+	std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
+
+	for (int f = 0; f < n_features; f++) {
+		if (is_dense[f]) continue;
+		before += sizeof(ev_pair_t)*size[f];
+		after += cx[f].memory_usage();
+		x[f] = nullptr;
+	}
+	/* the raw columns are not needed any more */
+	if (x_data != nullptr) {
+		delete[] x_data;
+		x_data = nullptr;
+	}
+	if (cache_buf != nullptr) {
+		/* the dense columns of a cache file or a shared segment point into the mapping, copy them out first */
+		size_t n_dense = 0, offset = 0;
+		for (int f = 0; f < n_features; f++) {
+			if (is_dense[f]) n_dense++;
+		}
+		if (n_dense > 0) {
+			dense_value_data = new feature_t[n_dense*n_examples];
+			order_data = new int[n_dense*n_examples];
+			for (int f = 0; f < n_features; f++) {
+				if (!is_dense[f]) continue;
+				memcpy(dense_value_data + offset, dense_value[f], sizeof(feature_t)*n_examples);
+				memcpy(order_data + offset, order[f], sizeof(int)*n_examples);
+				dense_value[f] = dense_value_data + offset;
+				order[f] = order_data + offset;
+				offset += n_examples;
+			}
+		}
+		munmap(cache_buf, cache_size);
+		cache_buf = nullptr;
 	}
-	return ret;	
+	t->toc("Done.");
+	std::cout << "Columns: " << before / 1048576.0 << " MB -> " << after / 1048576.0 << " MB" << std::endl;
+	delete t;
 }
 
-std::vector<example_t*> data_reader::read_examples() {
-	example_t* single;
-	std::vector<example_t*> ret;
+void dataset::set_spill_file(const std::string& path) {
+	spill_path = path;
+}
 
-	while( (single=read_an_example()) != nullptr) {
-		ret.push_back(single);
-	}
+bool dataset::is_out_of_core() {
+	return pool != nullptr;
+}
 
-	return ret;
+void dataset::print_pool_stats() {
+	if (pool != nullptr) pool->print_stats();
 }
 
-dataset::dataset() {
-	is_init = false;
+bool dataset::is_compressed() {
+	return cx != nullptr;
 }
 
-dataset::dataset(int n_classes, int n_features, float* weight) {
-	init(n_classes, n_features, weight);
+int dataset::get_n_blocks(int f) {
+	return (size[f] + COLUMN_BLOCK_SIZE - 1) / COLUMN_BLOCK_SIZE;
 }
 
-dataset::~dataset() {
-	if (x != nullptr) {
-		delete[] x;
-		x = nullptr;
+const ev_pair_t* dataset::get_block(int f, int b, ev_pair_t* buf, int& n) {
+	const int* o;
+	if (is_dense[f]) {
+		n = std::min(COLUMN_BLOCK_SIZE, size[f] - b*COLUMN_BLOCK_SIZE);
+		o = order[f] + b*COLUMN_BLOCK_SIZE;
+		for (int j = 0; j < n; j++) buf[j].set(o[j], dense_value[f][o[j]]);
+		return buf;
 	}
-	if (size != nullptr) {
-		delete[] size;
-		size = nullptr;
+	if (pool != nullptr) {
+		n = pool->read_block(f, b, buf);
+		return buf;
 	}
-	if (valid_features != nullptr) {
-		delete[] valid_features;
-		valid_features = nullptr;
+	if (cx == nullptr) {
+		n = std::min(COLUMN_BLOCK_SIZE, size[f] - b*COLUMN_BLOCK_SIZE);
+		return x[f] + b*COLUMN_BLOCK_SIZE;
 	}
-	if (y != nullptr) {
-		delete[] y;
-		y = nullptr;
+	n = cx[f].decode_block(b, buf);
+	return buf;
+}
+
+int dataset::upper_bound(int f, feature_t v) {
+	ev_pair_t* p;
+	int k, u, m;
+
+	if (is_dense[f]) {
+		k = 0;
+		u = size[f];
+		while (k < u) {
+			m = (k + u) / 2;
+			if (dense_value[f][order[f][m]] > v)
+				u = m;
+			else 
+				k = m + 1;
+		}
+		return k;
 	}
-	if (is_cate != nullptr) {
-		delete[] is_cate;	
-		is_cate = nullptr;
+	if (cx != nullptr) return cx[f].upper_bound(v);
+	if (pool != nullptr) return pool->upper_bound(f, v);
+
+	p = x[f];
+	k = 0;
+	u = size[f];
+	while (k < u) {
+		m = (k + u) / 2;	
+		if (p[m].fea_value > v)
+			u = m;
+		else 
+			k = m + 1;
 	}
-	if (weight != nullptr) {
-		delete[] weight;
-		weight = nullptr;
+	return k;
+}
+
+long long dataset::make_cache_header(cache_header_t& header, const std::string& source, bool with_dense) {
+	struct stat st;
+	long long pos;
+
+	if (stat(source.c_str(), &st) < 0) {
+		std::cerr << "Can not stat file " << source << " ." << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	if (cx != nullptr) {
+		std::cerr << "Can not save the cache of a compressed dataset, call `save_cache` or `publish_shared` before `compress`" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	memset(&header, 0, sizeof(cache_header_t));
+	memcpy(header.magic, DATASET_CACHE_MAGIC, sizeof(header.magic));
+	header.version = DATASET_CACHE_VERSION;
+	header.feature_size = sizeof(feature_t);
+	header.target_size = sizeof(target_t);
+	header.n_classes = n_classes;
+	header.n_examples = n_examples;
+	header.n_features = n_features;
+	header.n_valid = n_valid;
+	header.n_dense = 0;
+	header.nnz = 0;
+	for (int f = 0; f < n_features; f++) {
+		if (with_dense && n_examples > 0 && size[f] == n_examples) header.n_dense++;
+		else header.nnz += size[f];
 	}
+	header.n_label_map = label_map.size();
+	header.source_size = st.st_size;
+	header.source_mtime = st.st_mtime;
+	/* put `x` at a page boundary so it can be used right after mapping */
+	pos = sizeof(cache_header_t) + sizeof(int)*(n_features + n_valid) + sizeof(bool)*n_features + sizeof(target_t)*n_examples
+		+ sizeof(int)*2*header.n_label_map;
+	header.data_offset = (pos + 4095) / 4096 * 4096;
+	if (header.n_dense > 0) header.dense_offset = (header.data_offset + header.nnz*(long long)sizeof(ev_pair_t) + 4095) / 4096 * 4096;
+	return pos;
 }
 
-void dataset::init(int n_classes, int n_features, float* weight) {
-	this->n_classes = n_classes;
-	this->n_features = n_features;
-	this->x = new ev_pair_t*[this->n_features];
-	this->y = nullptr;
-	this->size = new int[this->n_features]();
-	this->valid_features = new int[this->n_features]();
-	this->n_valid = 0;
-	/* copy weight vector to dataset */
-	this->weight = new float[this->n_classes];
-	memcpy(this->weight, weight, sizeof(float)*this->n_classes);
+long long dataset::cache_content_size(const cache_header_t& header) {
+	if (header.n_dense > 0) return header.dense_offset + header.n_dense*(long long)header.n_examples*(sizeof(feature_t) + sizeof(int));
+	return header.data_offset + header.nnz*(long long)sizeof(ev_pair_t);
+}
 
-	this->is_cate = new bool[this->n_features];
-	this->is_init = true;
+bool dataset::is_cache_of_source(const cache_header_t& header, const std::string& source, long long image_size, bool padded) {
+	struct stat st;
+	long long content_size = cache_content_size(header);
+
+	if (stat(source.c_str(), &st) < 0) return false;
+	/* rebuild if anything the cache depends on has changed */
+	return memcmp(header.magic, DATASET_CACHE_MAGIC, sizeof(header.magic)) == 0
+			&& header.version == DATASET_CACHE_VERSION
+			&& header.feature_size == sizeof(feature_t)
+			&& header.target_size == sizeof(target_t)
+			&& header.source_size == (long long)st.st_size
+			&& header.source_mtime == (long long)st.st_mtime
+			&& (padded ? content_size <= image_size : content_size == image_size);
 }
 
-void dataset::load_data(const std::string& filename, const learn_mode mode) {
-	data_reader* dr = new data_reader(filename, n_features, mode);
-	std::vector<example_t*> ex_vec;
-	/* te and tf correspond to each other */
-	ev_pair_t* te; /* store ev_pair*/
-	int* tf; /* store feature_id for sorting */
-	int tot_size; /* total size in the dataset */
-	m_timer* t = new m_timer();
+bool dataset::is_cache_current(const cache_header_t& header, const std::string& source, long long image_size, bool padded) {
+	return header.n_classes == n_classes
+			&& header.n_features == n_features
+			&& is_cache_of_source(header, source, image_size, padded);
+}
 
-	this->mode = mode;
+bool dataset::read_cache_counts(const std::string& path, bool shared, const std::string& source, int& n_classes, int& n_features) {
+	cache_header_t header;
+	struct stat st;
+	int fd = shared ? open_shared(path, O_RDONLY) : open(path.c_str(), O_RDONLY);
+	bool ok;
 
-	if (!is_init) {
-		std::cerr << "Please init the dataset first" << std::endl;
-		exit(EXIT_FAILURE);
+	if (fd < 0) return false;
+	/* the magic of a segment is written last, so a segment which is still being published is not used */
+	ok = fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(cache_header_t)
+			&& pread(fd, &header, sizeof(cache_header_t), 0) == sizeof(cache_header_t)
+			&& is_cache_of_source(header, source, st.st_size, shared);
+	close(fd);
+	if (!ok) return false;
+	n_classes = header.n_classes;
+	n_features = header.n_features;
+	return true;
+}
+
+void dataset::read_cache_meta(const cache_header_t& header, const char* p) {
+	this->mode = TRAIN;
+	n_examples = header.n_examples;
+	n_valid = header.n_valid;
+	memcpy(size, p, sizeof(int)*n_features);
+	p += sizeof(int)*n_features;
+	memcpy(valid_features, p, sizeof(int)*n_valid);
+	p += sizeof(int)*n_valid;
+	memcpy(is_cate, p, sizeof(bool)*n_features);
+	p += sizeof(bool)*n_features;
+	y = new target_t[n_examples > 0 ? n_examples : 1];
+	memcpy(y, p, sizeof(target_t)*n_examples);
+	p += sizeof(target_t)*n_examples;
+	/* `append` changes the labels of the new examples with the map of the original `load_data` */
+	label_map.clear();
+	for (int i = 0; i < header.n_label_map; i++) {
+		int pair[2];
+		memcpy(pair, p, sizeof(pair));
+		p += sizeof(pair);
+		label_map[pair[0]] = pair[1];
 	}
+}
 
-	/* read examples */
-	t->tic("Loading data from file "+filename+" ...");
-	ex_vec = dr->read_examples();
-	n_examples = ex_vec.size();
-	t->toc("Done.");
+void dataset::point_columns(const cache_header_t& header) {
+	ev_pair_t* data = (ev_pair_t*)(cache_buf + header.data_offset);
+	feature_t* value = (feature_t*)(cache_buf + header.dense_offset);
+	int* sorted = (int*)(value + (size_t)header.n_dense*n_examples);
 
-	/* generate dataset */
-	t->tic("Generating dataset ...");
-	te = new ev_pair_t[1];
-	tf = new int[1];
-	tot_size = 0;
-	int ex_id = 0;
-
-	/* change labels if they are not between 0 and n_classes-1 */
-	std::map<int, int> label_map;
-	bool *label_mask = new bool[n_classes];
-	int l;
-	/* initalize the label_mask to false */
-	for (int c = 0; c < n_classes; c++) label_mask[c] = false;
-	/* set label_mask entry to true it there exist y in datasets which is between 0 and n_classes-1 */
-	for (auto it = ex_vec.begin(); it != ex_vec.end(); it++) {
-		l = (*it)->y;
-		if (l < 0 && l >= n_classes) {
-			label_map[l] = -1; // -1 is no meaning just a place holder
+	for (int f = 0; f < n_features; f++) {
+		is_dense[f] = (header.n_dense > 0 && size[f] == n_examples);
+		if (is_dense[f]) {
+			x[f] = nullptr;
+			dense_value[f] = value;
+			order[f] = sorted;
+			value += n_examples;
+			sorted += n_examples;
 		} else {
-			label_mask[l] = true;
+			x[f] = data;
+			dense_value[f] = nullptr;
+			order[f] = nullptr;
+			data += size[f];
 		}
 	}
-	l = -1;
+}
+
+void dataset::save_cache(const std::string& cache_path, const std::string& source) {
+	cache_header_t header;
+	std::string tmp_path = cache_path + ".tmp";
+	std::ofstream out;
+	const char pad[4096] = {0};
+	long long pos = make_cache_header(header, source, false);
+
+	/* write to a temporary file first, so a broken cache is never seen by other runs */
+	out.open(tmp_path, std::ios::binary);
+	if (!out.is_open()) {
+		std::cerr << "Fail to open " << tmp_path << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	out.write((char*)&header, sizeof(cache_header_t));
+	out.write((char*)size, sizeof(int)*n_features);
+	out.write((char*)valid_features, sizeof(int)*n_valid);
+	out.write((char*)is_cate, sizeof(bool)*n_features);
+	out.write((char*)y, sizeof(target_t)*n_examples);
 	for (auto it = label_map.begin(); it != label_map.end(); it++) {
-		/* find an avaiable label value(between 0 and n_classes-1) */
-		while (label_mask[++l] == true);
-		label_mask[l] = true;
-		it->second = l;
+		int pair[2] = {it->first, it->second};
+		out.write((char*)pair, sizeof(pair));
 	}
-	/* change labels to between 0 and n_classes-1 */
-	for (int i = 0; i < ex_vec.size(); i++) {
-		example_t* p = ex_vec[i];	
-		if (p->y < 0 && p->y >= n_classes) {
-			p->y = label_map[p->y];
+	out.write(pad, header.data_offset - pos);
+	/* dense columns are saved as sorted pairs too */
+	ev_pair_t* buf = new ev_pair_t[COLUMN_BLOCK_SIZE];
+	const ev_pair_t* col;
+	int n;
+	for (int f = 0; f < n_features; f++) {
+		for (int b = 0; b < get_n_blocks(f); b++) {
+			col = get_block(f, b, buf, n);
+			out.write((char*)col, sizeof(ev_pair_t)*n);
 		}
 	}
-	
-	/* test mode does not need y array*/
-	if (mode != TEST) {
-		y = new target_t[1];
-	}
-	for (auto it = ex_vec.begin(); it != ex_vec.end(); it++, ex_id++) {
-		/* allocate memory to variables */
-		te = (ev_pair_t*)realloc(te, sizeof(ev_pair_t)*(tot_size+(*it)->nnz));
-		tf = (int*)realloc(tf, sizeof(int)*(tot_size+(*it)->nnz));
-		/* test mode does not has label */
-		if (mode != TEST) {
-			y = (target_t*)realloc(y, sizeof(target_t)*(ex_id+1));
-			/* check `y` between 0 ~ n_classes-1 */
-			if ((*it)->y < 0 && (*it)->y >= n_classes) {
-				std::cerr << "Label must between 0 and `n_classes`-1" << std::endl;
-				exit(EXIT_FAILURE);
-			}
-			y[ex_id] = (*it)->y;
+	delete[] buf;
+	out.close();
+	if (out.fail() || rename(tmp_path.c_str(), cache_path.c_str()) < 0) {
+		std::cerr << "Fail to write cache file " << cache_path << std::endl;
+		exit(EXIT_FAILURE);
+	}
+}
+
+bool dataset::load_cache(const std::string& cache_path, const std::string& source, size_t memory_budget, int n_threads) {
+	cache_header_t header;
+	struct stat cache_st;
+	char* meta = nullptr;
+	int fd;
+
+	if (!is_init) {
+		std::cerr << "Please init the dataset first" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	fd = open(cache_path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	if (fstat(fd, &cache_st) < 0 || cache_st.st_size < (off_t)sizeof(cache_header_t)
+			|| pread(fd, &header, sizeof(cache_header_t), 0) != sizeof(cache_header_t)) {
+		close(fd);
+		return false;
+	}
+	if (!is_cache_current(header, source, cache_st.st_size, false)) {
+		std::cout << "Dataset cache " << cache_path << " is out of date, rebuild it." << std::endl;
+		close(fd);
+		return false;
+	}
+
+	if (memory_budget > 0) {
+		/* only read what is before the columns now, the columns are read by the pool on demand */
+		meta = new char[header.data_offset];
+		if (pread(fd, meta, header.data_offset, 0) != (ssize_t)header.data_offset) {
+			delete[] meta;
+			close(fd);
+			return false;
 		}
+		read_cache_meta(header, meta + sizeof(cache_header_t));
+		delete[] meta;
+		for (int f = 0; f < n_features; f++) x[f] = nullptr;
+		pool = new column_pool(fd, header.data_offset, n_features, size, memory_budget);
+		return true;
+	}
+
+	cache_size = cache_st.st_size;
+	cache_buf = (char*)mmap(nullptr, cache_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (cache_buf == MAP_FAILED) {
+		cache_buf = nullptr;
+		return false;
+	}
+	read_cache_meta(header, cache_buf + sizeof(cache_header_t));
+
+	/* columns are used in place */
+	point_columns(header);
+	build_dense(n_threads);
+	return true;
+}
+
+int dataset::open_shared(const std::string& name, int flags) {
+	if (name.size() > 1 && name[0] == '/' && name.find('/', 1) == std::string::npos) 
+		return shm_open(name.c_str(), flags, 0644);
+	return open(name.c_str(), flags, 0644);
+}
+
+void dataset::remove_shared(const std::string& name) {
+	if (name.size() > 1 && name[0] == '/' && name.find('/', 1) == std::string::npos) shm_unlink(name.c_str());
+	else unlink(name.c_str());
+}
+
+bool dataset::publish_shared(const std::string& name, const std::string& source) {
+	cache_header_t header;
+	struct stat st;
+	char *image, *p;
+	const ev_pair_t* col;
+	ev_pair_t* buf;
+	feature_t* value;
+	int* sorted;
+	size_t image_size;
+	int fd, n, k;
+	m_timer* t = new m_timer();
+
+	make_cache_header(header, source, true);
 
-		for (int i = 0; i < (*it)->nnz; i++) {
-			size[(*it)->fea_id[i]]++;
-			tf[tot_size] = (*it)->fea_id[i];
-			te[tot_size].set(ex_id, (*it)->fea_value[i]);
-			tot_size++;
+	fd = open_shared(name, O_RDWR | O_CREAT | O_EXCL);
+	if (fd < 0) {
+		if (errno == EEXIST) {
+			std::cout << "Shared dataset " << name << " exists, it is not published again "
+				<< "(remove it if no process is publishing it)." << std::endl;
+		} else {
+			std::cerr << "Fail to create shared dataset " << name << ": " << strerror(errno) << std::endl;
 		}
+		delete t;
+		return false;
+	}
+	t->tic("Publishing the dataset to " + name + " ...");
+	/* the size of a hugetlbfs file must be a multiple of the huge page size, which is its block size */
+	image_size = cache_content_size(header);
+	if (fstat(fd, &st) == 0 && st.st_blksize > 0) image_size = (image_size + st.st_blksize - 1) / st.st_blksize * st.st_blksize;
+	if (ftruncate(fd, image_size) < 0 
+			|| (image = (char*)mmap(nullptr, image_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		std::cerr << "Fail to allocate shared dataset " << name << ": " << strerror(errno) << std::endl;
+		close(fd);
+		remove_shared(name);
+		delete t;
+		return false;
 	}
+	close(fd);
 
-	sort(te, tf, tot_size);
-	int t_sum = 0;
-	x[0] = te;
-	for (int i = 1; i < n_features; i++) {
-		t_sum += size[i-1];
-		x[i] = x[0] + t_sum;	
+	/* the magic is written at last, a reader does not use the segment before it is complete */
+	p = image;
+	memcpy(p, &header, sizeof(cache_header_t));
+	memset(p, 0, sizeof(header.magic));
+	p += sizeof(cache_header_t);
+	memcpy(p, size, sizeof(int)*n_features);
+	p += sizeof(int)*n_features;
+	memcpy(p, valid_features, sizeof(int)*n_valid);
+	p += sizeof(int)*n_valid;
+	memcpy(p, is_cate, sizeof(bool)*n_features);
+	p += sizeof(bool)*n_features;
+	memcpy(p, y, sizeof(target_t)*n_examples);
+	p += sizeof(target_t)*n_examples;
+	for (auto it = label_map.begin(); it != label_map.end(); it++) {
+		int pair[2] = {it->first, it->second};
+		memcpy(p, pair, sizeof(pair));
+		p += sizeof(pair);
 	}
+	p = image + header.data_offset;
+	value = (feature_t*)(image + header.dense_offset);
+	sorted = (int*)(value + (size_t)header.n_dense*n_examples);
+	buf = new ev_pair_t[COLUMN_BLOCK_SIZE];
+	for (int f = 0; f < n_features; f++) {
+		/* a dense column goes to its `dense_value` and `order` arrays, so attaching it copies nothing */
+		bool dense = (header.n_dense > 0 && size[f] == n_examples);
+		k = 0;
+		for (int b = 0; b < get_n_blocks(f); b++) {
+			col = get_block(f, b, buf, n);
+			if (dense) {
+				for (int j = 0; j < n; j++, k++) {
+					sorted[k] = col[j].ex_id;
+					value[col[j].ex_id] = col[j].fea_value;
+				}
+			} else {
+				memcpy(p, col, sizeof(ev_pair_t)*n);
+				p += sizeof(ev_pair_t)*n;
+			}
+		}
+		if (dense) {
+			value += n_examples;
+			sorted += n_examples;
+		}
+	}
+	delete[] buf;
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(image, DATASET_CACHE_MAGIC, sizeof(header.magic));
+
+	/* drop the private columns and use the shared ones like any other process */
+	release_columns();
+	cache_buf = image;
+	cache_size = image_size;
+	point_columns(header);
 	t->toc("Done.");
+	delete t;
+	return true;
+}
 
-	/** find valid features **/
-	for (int i = 0; i < n_features; i++) {
-		if (this->size[i] > 0) {
-			this->valid_features[this->n_valid++] = i;
+bool dataset::attach_shared(const std::string& name, const std::string& source) {
+	cache_header_t header;
+	struct stat st;
+	int fd;
+
+	if (!is_init) {
+		std::cerr << "Please init the dataset first" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	fd = open_shared(name, O_RDONLY);
+	if (fd < 0) return false;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(cache_header_t)) {
+		close(fd);
+		return false;
+	}
+	cache_size = st.st_size;
+	cache_buf = (char*)mmap(nullptr, cache_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (cache_buf == MAP_FAILED) {
+		cache_buf = nullptr;
+		return false;
+	}
+	if (memcmp(cache_buf, DATASET_CACHE_MAGIC, sizeof(header.magic)) != 0) {
+		std::cout << "Shared dataset " << name << " is not complete yet." << std::endl;
+		munmap(cache_buf, cache_size);
+		cache_buf = nullptr;
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	memcpy(&header, cache_buf, sizeof(cache_header_t));
+	if (!is_cache_current(header, source, cache_size, true)) {
+		std::cout << "Shared dataset " << name << " is out of date, remove it." << std::endl;
+		munmap(cache_buf, cache_size);
+		cache_buf = nullptr;
+		remove_shared(name);
+		return false;
+	}
+	read_cache_meta(header, cache_buf + sizeof(cache_header_t));
+
+	/* columns are used in place, the pages are shared by all the processes which attach the segment */
+	point_columns(header);
+	return true;
+}
+
+uint32_t dataset::radix_key(feature_t v) {
+	uint32_t u;
+	memcpy(&u, &v, sizeof(uint32_t));
+	/* negative values: flip all bits, positive values: flip the sign bit */
+	return u ^ ((u >> 31) ? 0xFFFFFFFFu : 0x80000000u);
+}
+
+void dataset::sort_column(ev_pair_t* a, int n, ev_pair_t* tmp, bool sort_ties) {
+	const int insertion_size = 64;
+	int count[8][256];
+	ev_pair_t *src = a, *dst = tmp, e;
+	uint32_t k;
+	int i, j, b, sum, c;
+
+	if (n < insertion_size) {
+		for (i = 1; i < n; i++) {
+			e = a[i];
+			for (j = i; j > 0 && (a[j-1].fea_value > e.fea_value 
+					|| (sort_ties && a[j-1].fea_value == e.fea_value && a[j-1].ex_id > e.ex_id)); j--) a[j] = a[j-1];
+			a[j] = e;
 		}
+		return;
 	}
 
-	/* free space */
-	if (tf != nullptr) {
-		delete[] tf;
-		tf = nullptr;
-	}
-	if (label_mask != nullptr) {
-		delete[] label_mask;
-		label_mask = nullptr;
-	}
-}
-
-void dataset::isort(ev_pair_t* a, int* f, int n){
-    int i,j;
-    float tv;
-    int te;
-    for(i=1; i<n; i++){
-        for(j=i; j>0 && (f[j-1] > f[j] || (f[j-1] == f[j] && a[j-1].fea_value > a[j].fea_value)); j--){
-            te=f[j];         	f[j]=f[j-1];                 		f[j-1]=te;
-            te=a[j].ex_id; 		a[j].ex_id=a[j-1].ex_id; 			a[j-1].ex_id=te;
-            tv=a[j].fea_value;  a[j].fea_value=a[j-1].fea_value;    a[j-1].fea_value=tv;
-        }
-    }
-}
-
-void dataset::qsortlazy(ev_pair_t* a, int* f, int l, int u){
-    int i,j,r;
-    float sv,tv;
-    int se,te;
-    if (u-l<7)
-        return;
-    r=l+rand()%(u-l);
-    te=a[r].ex_id; 		a[r].ex_id=a[l].ex_id; 			a[l].ex_id=te;
-    tv=a[r].fea_value;  a[r].fea_value=a[l].fea_value;  a[l].fea_value=tv;
-    te=f[r];         	f[r]=f[l];                 		f[l]=te;
-    i=l;
-    j=u+1;
-    while(1){
-        do i++; while (i<=u && (f[i] < te || (f[i]==te && a[i].fea_value < tv)));
-        do j--; while (f[j] > te || (f[j]==te && a[j].fea_value > tv));
-        if (i>j)
-            break;
-        se=f[i];        	f[i]=f[j];           	    	 f[j]=se;
-        se=a[i].ex_id; 		a[i].ex_id=a[j].ex_id; 			 a[j].ex_id=se;
-        sv=a[i].fea_value;  a[i].fea_value=a[j].fea_value;   a[j].fea_value=sv;
-    }
-    te=a[l].ex_id; 		a[l].ex_id=a[j].ex_id; 			a[j].ex_id=te;
-    tv=a[l].fea_value;  a[l].fea_value=a[j].fea_value;  a[j].fea_value=tv;
-    te=f[l];         	f[l]=f[j];                 		f[j]=te;
-    qsortlazy(a,f,l,j-1);
-    qsortlazy(a,f,j+1,u);
-}
-
-void dataset::sort(ev_pair_t* a, int* f, int len){
-    qsortlazy(a,f,0,len-1);
-    isort(a,f,len);
+	/* byte `b` of the key, bytes 0-3 are `ex_id` and bytes 4-7 are the feature value */
+	auto digit = [](const ev_pair_t& e, int b) -> uint32_t {
+		return b < 4 ? ((uint32_t)e.ex_id >> (8*b)) & 0xFF : (radix_key(e.fea_value) >> (8*(b-4))) & 0xFF;
+	};
+
+	/* histogram of all key bytes in one pass */
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < n; i++) {
+		k = radix_key(a[i].fea_value);
+		for (b = 0; b < 4; b++) count[4+b][(k >> (8*b)) & 0xFF]++;
+		if (sort_ties) {
+			k = (uint32_t)a[i].ex_id;
+			for (b = 0; b < 4; b++) count[b][(k >> (8*b)) & 0xFF]++;
+		}
+	}
+	for (b = sort_ties ? 0 : 4; b < 8; b++) {
+		/* skip the byte if all keys share it (e.g. high bytes of a narrow value range) */
+		if (count[b][digit(a[0], b)] == n) continue;
+		sum = 0;
+		for (i = 0; i < 256; i++) {
+			c = count[b][i];
+			count[b][i] = sum;
+			sum += c;
+		}
+		for (i = 0; i < n; i++) dst[count[b][digit(src[i], b)]++] = src[i];
+		std::swap(src, dst);
+	}
+	if (src != a) memcpy(a, src, sizeof(ev_pair_t)*n);
+}
+
+void dataset::sort(int n_threads, bool sort_ties) {
+	std::vector<int> order;
+	std::vector<std::thread> threads;
+	std::atomic<int> next(0);
+
+	if (n_threads <= 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+
+	/* sort the longest column first so that the threads finish at about the same time */
+	for (int f = 0; f < n_features; f++) {
+		if (size[f] > 1) order.push_back(f);
+	}
+	std::sort(order.begin(), order.end(), [&](int a, int b) { return size[a] > size[b]; });
+	n_threads = std::max(1, std::min(n_threads, (int)order.size()));
+
+	auto sort_worker = [&]() {
+		/* thread local scratch buffer, the first column is the longest */
+		std::vector<ev_pair_t> tmp;
+		int i, f;
+		while ((i = next++) < (int)order.size()) {
+			f = order[i];
+			if ((int)tmp.size() < size[f]) tmp.resize(size[f]);
+			sort_column(x[f], size[f], tmp.data(), sort_ties);
+		}
+	};
+	for (int i = 1; i < n_threads; i++) threads.push_back(std::thread(sort_worker));
+	sort_worker();
+	std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
 }
 
 int dataset::get_n_classes() {
@@ -359,13 +2579,20 @@ void dataset::debug() {
 		std::cout << std::endl;
 	}
 	std::cout << "Features: " << std::endl;
+	ev_pair_t* buf = new ev_pair_t[COLUMN_BLOCK_SIZE];
+	const ev_pair_t* col;
+	int n;
 	for (int i = 0; i < n_features; i++) {
 		std::cout << "#" << i << "--> ";
-		for (int j = 0; j < size[i]; j++) {
-			std::cout << x[i][j].ex_id << ":" << x[i][j].fea_value << " ";
+		for (int b = 0; b < get_n_blocks(i); b++) {
+			col = get_block(i, b, buf, n);
+			for (int j = 0; j < n; j++) {
+				std::cout << col[j].ex_id << ":" << col[j].fea_value << " ";
+			}
 		}
 		std::cout << std::endl;
 	}
+	delete[] buf;
 
 	std::cout << std::endl;
 }
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <vector> 
 #include <string>
+#include <chrono>
 
 #include "forest.h"
 #include "dataset.h"
@@ -45,6 +46,417 @@ void debug_data_reader() {
 		(*it)->debug();
 }
 
+/* the getline/substr/atof reader which `data_reader` used before, kept only as a benchmark baseline */
+std::vector<example_t*> legacy_read_examples(const std::string& filename) {
+	std::ifstream ifs(filename.c_str(), std::ios::binary);
+	std::vector<example_t*> ret;
+	std::string line;
+	int p_pos, c_pos;
+	target_t y;
+
+	while (ifs >> y) {
+		example_t* ex = new example_t();
+		ex->y = y;
+		p_pos = 0; getline(ifs, line);
+		c_pos = line.find(' ', 0);
+		while (p_pos <= c_pos) {
+			p_pos = c_pos + 1;
+			c_pos = line.find(':', p_pos);
+			if (c_pos == -1) break;
+			int feature_id = atoi(line.substr(p_pos, c_pos - p_pos).c_str()) - 1;
+			p_pos = c_pos + 1;
+			c_pos = line.find(' ', p_pos);
+			ex->push_back(feature_id, atof(line.substr(p_pos, c_pos - p_pos).c_str()));
+		}
+		ret.push_back(ex);
+	}
+	return ret;
+}
+
+void bench_data_reader(const std::string& filename, int n_features) {
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::duration<double> elapsed;
+	std::vector<example_t*> ex_vec;
+	double mb;
+
+	begin = std::chrono::steady_clock::now();
+	ex_vec = legacy_read_examples(filename);
+	elapsed = std::chrono::steady_clock::now() - begin;
+	for (auto it = ex_vec.begin(); it != ex_vec.end(); it++) delete *it;
+
+	data_reader* dr = new data_reader(filename, n_features, TRAIN);
+	mb = dr->get_file_size() / 1048576.0;
+	std::cout << "getline reader: " << ex_vec.size() << " examples, "
+		<< elapsed.count() << "s, " << mb / elapsed.count() << " MB/s" << std::endl;
+
+	begin = std::chrono::steady_clock::now();
+	ex_vec = dr->read_examples();
+	elapsed = std::chrono::steady_clock::now() - begin;
+	for (auto it = ex_vec.begin(); it != ex_vec.end(); it++) delete *it;
+	std::cout << "mmap reader: " << ex_vec.size() << " examples, "
+		<< elapsed.count() << "s, " << mb / elapsed.count() << " MB/s" << std::endl;
+
+	delete dr;
+}
+
+void bench_compressed_input(const std::string& filename, int n_threads) {
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::duration<double> elapsed;
+	example_batch batch;
+	double mb;
+
+	/* decompress only, then parse the decompressed content */
+	begin = std::chrono::steady_clock::now();
+	data_reader* dr = new data_reader(filename, 0, TRAIN);
+	mb = dr->get_file_size() / 1048576.0;
+	elapsed = std::chrono::steady_clock::now() - begin;
+	std::cout << "decompress: " << elapsed.count() << "s, " << mb / elapsed.count() << " MB/s" << std::endl;
+	dr->read_examples(batch, n_threads);
+	elapsed = std::chrono::steady_clock::now() - begin;
+	std::cout << "decompress then parse: " << elapsed.count() << "s" << std::endl;
+	delete dr;
+
+	/* parse the chunks while the rest of the file is being decompressed */
+	batch.clear();
+	begin = std::chrono::steady_clock::now();
+	dr = new data_reader(filename, 0, TRAIN);
+	dr->read_examples(batch, n_threads);
+	elapsed = std::chrono::steady_clock::now() - begin;
+	std::cout << "pipelined: " << batch.get_n_examples() << " examples, " << elapsed.count() << "s, " 
+		<< mb / elapsed.count() << " MB/s" << std::endl;
+	delete dr;
+}
+
+void bench_append(const std::string& base_file, const std::string& new_file, int n_features) {
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::duration<double> elapsed;
+	float* weight = new float[2];
+	weight[0] = weight[1] = 1.0;
+
+	dataset* d = new dataset(2, n_features, weight);
+	begin = std::chrono::steady_clock::now();
+	d->load_data(base_file, TRAIN);
+	elapsed = std::chrono::steady_clock::now() - begin;
+	std::cout << "load_data: " << d->get_n_examples() << " examples, " << elapsed.count() << "s" << std::endl;
+
+	data_reader* dr = new data_reader(new_file, n_features, TRAIN);
+	example_batch new_data;
+	dr->read_examples(new_data, DEFAULT_N_THREADS);
+	delete dr;
+	begin = std::chrono::steady_clock::now();
+	d->append(new_data);
+	elapsed = std::chrono::steady_clock::now() - begin;
+	std::cout << "append: " << new_data.get_n_examples() << " examples, " << elapsed.count() << "s" << std::endl;
+
+	delete d;
+	delete[] weight;
+}
+
+void debug_dense_missing() {
+	/* `NA`, `N/A`, `null`, `nan`, `?` and empty fields are missing values, `0` is a present value */
+	const char* filename = "./data/missing.csv";
+	const int expected[] = {4, 0, 2, 4};
+	std::ofstream ofs(filename);
+	ofs << "y,a,b,c,d\n"
+		<< "1,1.5,NA,0,2\n"
+		<< "0,2.5,?,,3\n"
+		<< "1,-1,N/A,nan,4\n"
+		<< "0,3,null,1,5\n";
+	ofs.close();
+
+	float* weight = new float[2];
+	weight[0] = weight[1] = 1.0;
+	dataset* d = new dataset(2, 4, weight);
+	d->load_data(filename, TRAIN, 1, DENSE);
+	for (int f = 0; f < 4; f++)
+		std::cout << "feature " << f << ": size " << d->size[f] << ", expected " << expected[f] 
+			<< (d->is_dense[f] ? ", dense" : ", sparse") << (d->size[f] == expected[f] ? "" : " MISMATCH") << std::endl;
+
+	delete d;
+	delete[] weight;
+	std::remove(filename);
+}
+
+int* bench_test_data(const std::string& test_file, int n_features, example_batch& test_data) {
+	data_reader* dr = new data_reader(test_file, n_features, TRAIN);
+	dr->read_examples(test_data, 1);
+	int n_test = test_data.get_n_examples();
+	int* y_true = new int[n_test];
+	for (int i = 0; i < n_test; i++) y_true[i] = test_data.y[i];
+	delete dr;
+	return y_true;
+}
+
+void bench_forest(const std::string& name, dataset* d, split_mode split, example_batch& test_data, int* y_true) {
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::duration<double> elapsed;
+	int n_test = test_data.get_n_examples();
+
+	random_forest_classifier* rf = new random_forest_classifier("sqrt", -1, 1, 10, 1, 0, split);
+	begin = std::chrono::steady_clock::now();
+	rf->build(d);
+	elapsed = std::chrono::steady_clock::now() - begin;
+	float* y_pred_zero = rf->predict_proba(test_data);
+	std::cout << std::endl << name << ": build " << elapsed.count() << "s, AUC = " 
+		<< Metrics::roc_auc_score(y_pred_zero + n_test, y_true, n_test) << std::endl;
+	delete[] y_pred_zero;
+	delete rf;
+}
+
+void bench_histogram_splitter(const std::string& train_file, const std::string& test_file, int n_features) {
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::duration<double> elapsed;
+	float* weight = new float[2];
+	weight[0] = weight[1] = 1.0;
+
+	dataset* d = new dataset(2, n_features, weight);
+	d->load_data(train_file, TRAIN);
+	begin = std::chrono::steady_clock::now();
+	d->build_bins(DEFAULT_MAX_BINS);
+	elapsed = std::chrono::steady_clock::now() - begin;
+	std::cout << "build_bins: " << elapsed.count() << "s" << std::endl;
+
+	example_batch test_data;
+	int* y_true = bench_test_data(test_file, n_features, test_data);
+	bench_forest("best_splitter", d, BEST_SPLIT, test_data, y_true);
+	bench_forest("hist_splitter", d, HISTOGRAM_SPLIT, test_data, y_true);
+
+	delete d;
+	delete[] y_true;
+	delete[] weight;
+}
+
+void bench_random_splitter(const std::string& train_file, const std::string& test_file, int n_features) {
+	float* weight = new float[2];
+	weight[0] = weight[1] = 1.0;
+
+	dataset* d = new dataset(2, n_features, weight);
+	d->load_data(train_file, TRAIN);
+
+	example_batch test_data;
+	int* y_true = bench_test_data(test_file, n_features, test_data);
+	bench_forest("best_splitter", d, BEST_SPLIT, test_data, y_true);
+	/* random thresholds make deeper trees, but each node costs a counting pass instead of a sort */
+	bench_forest("random_splitter", d, RANDOM_SPLIT, test_data, y_true);
+
+	delete d;
+	delete[] y_true;
+	delete[] weight;
+}
+
+void bench_categorical(const std::string& train_file, const std::string& test_file, int n_features, const std::vector<int>& categorical) {
+	std::string names[2] = {"as numbers", "as categories"};
+	float* weight = new float[2];
+	weight[0] = weight[1] = 1.0;
+
+	example_batch test_data;
+	int* y_true = bench_test_data(test_file, n_features, test_data);
+	for (int m = 0; m < 2; m++) {
+		dataset* d = new dataset(2, n_features, weight);
+		d->load_data(train_file, TRAIN);
+		/* a category id has no order, a threshold on it needs many splits to isolate a set of categories */
+		if (m == 1) d->set_categorical(categorical);
+		bench_forest(names[m], d, BEST_SPLIT, test_data, y_true);
+		delete d;
+	}
+
+	delete[] y_true;
+	delete[] weight;
+}
+
+void bench_shared_dataset(const std::string& filename, const std::string& name, int n_features) {
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::duration<double> elapsed;
+	float* weight = new float[2];
+	weight[0] = weight[1] = 1.0;
+
+	dataset::remove_shared(name);
+	dataset* d = new dataset(2, n_features, weight);
+	begin = std::chrono::steady_clock::now();
+	d->load_data(filename, TRAIN);
+	d->publish_shared(name, filename);
+	elapsed = std::chrono::steady_clock::now() - begin;
+	std::cout << "load and publish: " << elapsed.count() << "s" << std::endl;
+
+	dataset* a = new dataset(2, n_features, weight);
+	begin = std::chrono::steady_clock::now();
+	if (!a->attach_shared(name, filename)) std::cout << "Fail to attach " << name << std::endl;
+	elapsed = std::chrono::steady_clock::now() - begin;
+	std::cout << "attach: " << elapsed.count() << "s, " << a->get_n_examples() << " examples" << std::endl;
+
+	delete a;
+	delete d;
+	dataset::remove_shared(name);
+	delete[] weight;
+}
+
+void bench_tree_depth(const std::string& filename, int n_features) {
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::duration<double> elapsed;
+	int depths[5] = {4, 8, 12, 16, -1};
+	float* weight = new float[2];
+	weight[0] = weight[1] = 1.0;
+
+	dataset* d = new dataset(2, n_features, weight);
+	d->load_data(filename, TRAIN);
+	d->build_rows();
+	for (int i = 0; i < 5; i++) {
+		decision_tree* t = new decision_tree("sqrt", depths[i], 1, 0);
+		begin = std::chrono::steady_clock::now();
+		t->build(d);
+		elapsed = std::chrono::steady_clock::now() - begin;
+		/* the cost of a node is proportional to its examples, so the time per level should stay flat as the tree deepens */
+		std::cout << "max_depth " << depths[i] << ": build " << elapsed.count() << "s, " 
+			<< t->get_leaf_size() << " leaves" << std::endl;
+		delete t;
+	}
+
+	delete d;
+	delete[] weight;
+}
+
+void bench_grow_mode(const std::string& filename, int n_features) {
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::duration<double> elapsed;
+	int depths[4] = {4, 8, 12, 16};
+	grow_mode modes[2] = {DEPTH_FIRST, LEVEL_WISE};
+	const char* names[2] = {"depth-first", "level-wise"};
+	float* weight = new float[2];
+	weight[0] = weight[1] = 1.0;
+
+	dataset* d = new dataset(2, n_features, weight);
+	d->load_data(filename, TRAIN);
+	d->build_rows();
+	for (int i = 0; i < 4; i++) {
+		for (int m = 0; m < 2; m++) {
+			decision_tree* t = new decision_tree("sqrt", depths[i], 1, 0, BEST_SPLIT, modes[m]);
+			begin = std::chrono::steady_clock::now();
+			t->build(d);
+			elapsed = std::chrono::steady_clock::now() - begin;
+			/* a level costs one pass over each column tested by any of its nodes, however many nodes there are */
+			std::cout << names[m] << " max_depth " << depths[i] << ": build " << elapsed.count() << "s, " 
+				<< t->get_leaf_size() << " leaves" << std::endl;
+			delete t;
+		}
+	}
+
+	delete d;
+	delete[] weight;
+}
+
+void bench_parallel_split(const std::string& filename, int n_features) {
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::duration<double> elapsed;
+	int threads[4] = {1, 2, 4, 8};
+	float* weight = new float[2];
+	weight[0] = weight[1] = 1.0;
+
+	dataset* d = new dataset(2, n_features, weight);
+	d->load_data(filename, TRAIN);
+	d->build_rows();
+	for (int i = 0; i < 4; i++) {
+		decision_tree* t = new decision_tree("sqrt", 16, 1, 0, BEST_SPLIT, DEPTH_FIRST, threads[i]);
+		begin = std::chrono::steady_clock::now();
+		t->build(d);
+		elapsed = std::chrono::steady_clock::now() - begin;
+		/* only the nodes with `PARALLEL_SPLIT_MIN_EXAMPLES` examples use the threads, the tree is the same */
+		std::cout << threads[i] << " threads: build " << elapsed.count() << "s, " 
+			<< t->get_leaf_size() << " leaves" << std::endl;
+		delete t;
+	}
+
+	delete d;
+	delete[] weight;
+}
+
+void bench_subtree_tasks(const std::string& filename, int n_features) {
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::duration<double> elapsed;
+	int threads[4] = {1, 2, 4, 8};
+	float* weight = new float[2];
+	weight[0] = weight[1] = 1.0;
+
+	dataset* d = new dataset(2, n_features, weight);
+	d->load_data(filename, TRAIN);
+	d->build_rows();
+	for (int i = 0; i < 4; i++) {
+		task_scheduler* sched = new task_scheduler(threads[i]);
+		decision_tree* t = new decision_tree("sqrt", -1, 1, 0, BEST_SPLIT, DEPTH_FIRST);
+		/* a single deep tree, only its subtrees with `TASK_MIN_EXAMPLES` examples can keep the workers busy */
+		t->set_scheduler(sched);
+		begin = std::chrono::steady_clock::now();
+		t->build(d);
+		elapsed = std::chrono::steady_clock::now() - begin;
+		std::cout << threads[i] << " workers: build " << elapsed.count() << "s, " 
+			<< t->get_leaf_size() << " leaves" << std::endl;
+		delete t;
+		delete sched;
+	}
+
+	delete d;
+	delete[] weight;
+}
+
+void bench_binary_gini(int n_calls) {
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::duration<double> elapsed;
+	float* cur = new float[2];
+	float* left = new float[2];
+	float* right = new float[2];
+	float sum;
+	gini* g = new gini();
+	criterion* cr = g;
+	const char* name[3] = {"criterion::gain (measure per child)", "gini::gain (virtual)", "gini::gain_k<2> (inlined)"};
+
+	cur[0] = cur[1] = n_calls;
+	g->set_current(cur, 2);
+	for (int k = 0; k < 3; k++) {
+		sum = 0.0;
+		begin = std::chrono::steady_clock::now();
+		/* thresholds of a sorted column, one example moves to the left at a time */
+		for (int i = 1; i < n_calls; i++) {
+			left[0] = i;
+			left[1] = n_calls - i;
+			right[0] = cur[0] - left[0];
+			right[1] = cur[1] - left[1];
+			if (k == 0) sum += cr->criterion::gain(left, right, 2);
+			else if (k == 1) sum += cr->gain(left, right, 2);
+			else sum += g->gain_k<2>(left, right, 2);
+		}
+		elapsed = std::chrono::steady_clock::now() - begin;
+		std::cout << name[k] << ": " << elapsed.count() << "s (" << sum << ")" << std::endl;
+	}
+
+	delete g;
+	delete[] cur;
+	delete[] left;
+	delete[] right;
+}
+
+void bench_compressed_columns(const std::string& filename, int n_features) {
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::duration<double> elapsed;
+	float* weight = new float[2];
+	weight[0] = weight[1] = 1.0;
+
+	dataset* d = new dataset(2, n_features, weight);
+	d->load_data(filename, TRAIN);
+	for (int m = 0; m < 2; m++) {
+		/* the second round runs on compressed columns */
+		if (m == 1) d->compress();
+		random_forest_classifier* rf = new random_forest_classifier("sqrt", -1, 1, 10, 1, 0);
+		begin = std::chrono::steady_clock::now();
+		rf->build(d);
+		elapsed = std::chrono::steady_clock::now() - begin;
+		std::cout << std::endl << (m == 0 ? "raw columns" : "compressed columns") << ": build " 
+			<< elapsed.count() << "s" << std::endl;
+		delete rf;
+	}
+
+	delete d;
+	delete[] weight;
+}
+
 void debug_dataset() {
 	float* weight = new float[2];
 	weight[0] = weight[1] = 1.0;
@@ -144,6 +556,20 @@ void test_random_forest() {
 
 int main(int argc, char** argv) {
 	//debug_data_reader();
+	//debug_dense_missing();
+	//bench_data_reader("./data/webspam_wc_normalized_unigram.svm", 254);
+	//bench_append("./data/webspam_wc_normalized_unigram.svm", "./data/webspam_wc_normalized_unigram.svm.t", 254);
+	//bench_compressed_input("./data/webspam_wc_normalized_unigram.svm.gz", 4);
+	//bench_histogram_splitter("./data/gisette_scale", "./data/gisette_scale.t", 5000);
+	//bench_random_splitter("./data/gisette_scale", "./data/gisette_scale.t", 5000);
+	//bench_compressed_columns("./data/gisette_scale", 5000);
+	//bench_tree_depth("./data/webspam_wc_normalized_unigram.svm", 254);
+	//bench_grow_mode("./data/webspam_wc_normalized_unigram.svm", 254);
+	//bench_parallel_split("./data/webspam_wc_normalized_unigram.svm", 254);
+	//bench_subtree_tasks("./data/webspam_wc_normalized_unigram.svm", 254);
+	//bench_binary_gini(100000000);
+	//bench_shared_dataset("./data/webspam_wc_normalized_unigram.svm", "/rf_webspam", 254);
+	//bench_categorical("./data/adult.svm", "./data/adult.svm.t", 14, {1, 3, 5, 6, 7, 8, 9, 13});
 	//debug_dataset();
 	//debug_decision_tree();
 	//test_decision_tree();
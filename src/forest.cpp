@@ -13,19 +13,25 @@ forest::forest() {
 	this->min_split = 1;
 	this->n_trees = 10;
 	this->n_threads = 1;
+	this->split = BEST_SPLIT;
+	this->grow = DEPTH_FIRST;
+	this->hash_buckets = 0;
 
 	fea_imp = nullptr;
 
 	is_build = false;
 }
 
-forest::forest(const std::string feature_rule, int max_depth, int min_split, int n_trees, int n_threads, int verbose) {
+forest::forest(const std::string feature_rule, int max_depth, int min_split, int n_trees, int n_threads, int verbose, split_mode split, grow_mode grow) {
 	this->feature_rule = feature_rule;
+	this->split = split;
+	this->grow = grow;
 	this->max_depth  = max_depth;
 	this->min_split = min_split;
 	this->n_trees = n_trees;
 	this->n_threads = n_threads;
 	this->verbose = verbose;
+	this->hash_buckets = 0;
 
 	fea_imp = nullptr;
 
@@ -77,10 +83,10 @@ float* forest::compute_importance(bool re_compute) {
 	return tot_importance;
 }
 
-void forest::parallel_predict_proba(int tree_begin, int tree_end, std::vector<example_t*> &examples, float* ret) {
+void forest::parallel_predict_proba(int tree_begin, int tree_end, example_batch &examples, float* ret) {
 	tree* cur_tree;
 	float* sub_proba;
-	int example_size = examples.size();
+	int example_size = examples.get_n_examples();
 
 	for (int t = tree_begin; t < tree_end; t++) {
 		cur_tree = trees[t];	
@@ -103,10 +109,15 @@ void forest::parallel_predict_proba(int tree_begin, int tree_end, std::vector<ex
  * return [0.8, 0.9, 0.3, 0.2, 0.1, 0.7]
  */
 float* forest::predict_proba(std::vector<example_t*> &examples) {
+	example_batch batch(examples);
+	return predict_proba(batch);
+}
+
+float* forest::predict_proba(example_batch &examples) {
 	int example_size, tree_begin, tree_end;
 	float *ret; 
 
-	example_size = examples.size();
+	example_size = examples.get_n_examples();
 	ret = new float[example_size*this->n_classes]();
 
 	// init the parallel unit
@@ -168,9 +179,9 @@ int* forest::predict_label(std::vector<example_t*> &examples) {
  *
  * return [0, 5, 9, 8, 6, 2, 3, 10, 1]
  */
-void forest::parallel_apply(int tree_begin, int tree_end, std::vector<example_t*> &examples, int* ret) {
+void forest::parallel_apply(int tree_begin, int tree_end, example_batch &examples, int* ret) {
 	tree* c_tree;
-	int *sub_idx, example_size = examples.size();
+	int *sub_idx, example_size = examples.get_n_examples();
 
 	for (int t = tree_begin; t < tree_end; t++) {
 		c_tree = this->trees[t];	
@@ -178,12 +189,18 @@ void forest::parallel_apply(int tree_begin, int tree_end, std::vector<example_t*
 		for (int i = 0; i < example_size; i++) {
 			ret[t+i*this->n_trees] = sub_idx[i];
 		}
+		delete[] sub_idx;
 	}
 }
 
 // for each given example, return a leaf index which it lies in each tree
 int* forest::apply(std::vector<example_t*> &examples) {
-	int tree_begin, tree_end, example_size = examples.size();
+	example_batch batch(examples);
+	return apply(batch);
+}
+
+int* forest::apply(example_batch &examples) {
+	int tree_begin, tree_end, example_size = examples.get_n_examples();
 	int* ret;
 
 	ret = new int[example_size * this->n_trees]();
@@ -259,6 +276,26 @@ int* forest::get_leaf_counts() {
 	return ret;
 }
 
+std::vector<int> forest::get_used_features() {
+	std::vector<int> ret;
+	bool* used;
+	if (!check_build()) {
+		std::cerr << "Please build the forest before getting `used_features`" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	used = new bool[this->n_features]();
+	// collect split features of all trees
+	for (int t = 0; t < this->n_trees; t++) {
+		this->trees[t]->mark_used_features(used);
+	}
+	for (int f = 0; f < this->n_features; f++) {
+		if (used[f]) ret.push_back(f);
+	}
+	delete[] used;
+	return ret;
+}
+
 int forest::get_max_feature() {
 	if (!check_build()) {
 		std::cerr << "Please build the forest before getting `max_feature`" << std::endl;
@@ -283,12 +320,20 @@ int forest::get_n_classes() {
 	return this->n_classes;
 }
 
+int forest::get_feature_hash() {
+	if (!check_build()) {
+		std::cerr << "Please build the forest before getting `hash_buckets`" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	return this->hash_buckets;
+}
+
 bool forest::check_build() {
 	return is_build;
 }
 
-random_forest_classifier::random_forest_classifier(const std::string feature_rule, int max_depth, int min_split, int n_trees, int n_threads, int verbose) : 
-	forest(feature_rule, max_depth, min_split, n_trees, n_threads, verbose) {
+random_forest_classifier::random_forest_classifier(const std::string feature_rule, int max_depth, int min_split, int n_trees, int n_threads, int verbose, split_mode split, grow_mode grow) : 
+	forest(feature_rule, max_depth, min_split, n_trees, n_threads, verbose, split, grow) {
 
 }
 
@@ -300,10 +345,12 @@ random_forest_classifier::~random_forest_classifier() {
 	free_forest();
 }
 
-void random_forest_classifier::parallel_build(int tree_begin, int tree_end, dataset*&d) {
+void random_forest_classifier::parallel_build(int tree_begin, int tree_end, dataset*&d, int split_threads, task_scheduler* sched, split_workspace** workspace) {
 	for (int t = tree_begin; t < tree_end; t++) {
 		/* do not need any debug information to print during building process */
-		this->trees[t] = new decision_tree(this->feature_rule, this->max_depth, this->min_split, 0);
+		this->trees[t] = new decision_tree(this->feature_rule, this->max_depth, this->min_split, 0, this->split, this->grow, split_threads);
+		this->trees[t]->set_scheduler(sched);
+		this->trees[t]->set_workspace(workspace);
 		this->trees[t]->build(d);	
 		/* print a dot on the screen after build a tree */
 		std::cout << ".";
@@ -311,7 +358,10 @@ void random_forest_classifier::parallel_build(int tree_begin, int tree_end, data
 }
 
 void random_forest_classifier::build(dataset*& d) {
-	int tree_begin, tree_end;
+	int split_threads;
+	std::atomic<int> pending(0);
+	task_scheduler* sched;
+	split_workspace** workspace = nullptr;
 	m_timer* ti = new m_timer();
 
 	if (verbose >= 1) 
@@ -320,27 +370,35 @@ void random_forest_classifier::build(dataset*& d) {
 	/* collect information from dataset */
 	this->n_classes = d->get_n_classes();
 	this->n_features = d->get_n_features();
+	/* the input to predict must be hashed the same way */
+	this->hash_buckets = d->get_feature_hash();
 
 	/* initialize trees */
 	free_forest();
 	this->trees.reserve(this->n_trees);
-
-	/* parallel build tree */
+	/* parallel build tree, each tree is a task and so are its large subtrees, an idle worker steals whichever is left */
 	parallel_unit pu = init_block(this->n_trees, this->n_threads);
-	std::vector<std::thread> threads(pu.num_threads - 1);
-
-	tree_begin = 0;
-	for (int i = 0; i < pu.num_threads - 1; i++) {
-		tree_end = tree_begin + pu.block_size;
-		threads[i] = std::thread([&, tree_begin, tree_end]() {
-			parallel_build(tree_begin, tree_end, d);
-		});
-		tree_begin = tree_end;
+	/* with fewer trees than workers, the split of a large node is divided into tasks for the spare workers */
+	split_threads = init_block(this->n_threads, this->n_threads).num_threads / pu.num_threads;
+	sched = new task_scheduler(this->n_threads);
+	/* a worker reuses its splitter for every node of every tree it builds */
+	if (this->grow == DEPTH_FIRST) {
+		workspace = new split_workspace*[sched->get_n_workers()];
+		for (int w = 0; w < sched->get_n_workers(); w++) workspace[w] = new split_workspace(this->split, this->n_classes);
 	}
-	parallel_build(tree_begin, this->n_trees, d);
 
-	/* join all the threads */
-	std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
+	/* the deque is run from the back, so a single worker builds the trees in order */
+	for (int t = this->n_trees - 1; t >= 0; t--) {
+		sched->spawn([this, t, &d, split_threads, sched, workspace]() {
+			parallel_build(t, t+1, d, split_threads, sched, workspace);
+		}, pending);
+	}
+	sched->wait(pending);
+	if (workspace != nullptr) {
+		for (int w = 0; w < sched->get_n_workers(); w++) delete workspace[w];
+		delete[] workspace;
+	}
+	delete sched;
 
 	/* collect max_feature after build */
 	this->max_feature = this->trees[0]->get_max_feature();
@@ -366,6 +424,7 @@ void random_forest_classifier::dump(const std::string& filename) const {
 	out.write((char*)&this->n_threads, sizeof(int));
 	out.write((char*)&this->n_classes, sizeof(int));
 	out.write((char*)&this->n_features, sizeof(int));
+	out.write((char*)&this->hash_buckets, sizeof(int));
 
 	/* close file */
 	out.close();
@@ -394,12 +453,14 @@ void random_forest_classifier::load(const std::string& filename) {
 	this->n_threads = 1; // !!!!!!!!!!!!!!!!!!!!!! fixed for debug
 	in.read((char*)&this->n_classes, sizeof(int));
 	in.read((char*)&this->n_features, sizeof(int));
+	/* model files dumped before feature hashing do not have it */
+	if (!in.read((char*)&this->hash_buckets, sizeof(int))) this->hash_buckets = 0;
 
 	/* close file */
 	in.close();
 
 	/* allocate space for trees */
-	this->trees.reserve(this->n_trees); 
+	this->trees.resize(this->n_trees); 
 	/* load trees separately */
 	for (int t = 0; t < this->n_trees; t++) {
 		/* tree suffix is start from 1, 0 is for forest */
@@ -20,9 +20,20 @@ std::string error_msg(std::string msg) {
 	return color_msg(msg, "red");
 }
 
+data_format read_format(const libconfig::Setting& cfg, const std::string& section) {
+	std::string format;
+	if (!cfg.lookupValue("format", format) || format == "libsvm") return LIBSVM;
+	if (format == "csv" || format == "tsv") return DENSE;
+	std::cerr << error_msg("Bad value of `format` under `" + section + "`. Valid values are `libsvm`, `csv` and `tsv`.") << std::endl;
+	exit(EXIT_FAILURE);
+}
+
 int main(int argc, char** argv) {
-	int max_depth, min_sample_leaf, n_trees, n_threads, n_classes, n_features;
-	std::string config_path, criterion, train_path, test_path, validate_path, input_model_path, output_model_path, dot_file_path;
+	int max_depth, min_sample_leaf, n_trees, n_threads = DEFAULT_N_THREADS, n_classes, n_features, max_bins, memory_budget, hash_buckets;
+	bool compress, rows, has_n_classes, has_n_features;
+	split_mode split;
+	grow_mode grow;
+	std::string config_path, criterion, splitter, grow_order, train_path, cache_path, shared_name, test_path, validate_path, input_model_path, output_model_path, dot_file_path;
 	float* weight = nullptr;
 	libconfig::Config cfg;
 	dataset *d = nullptr;
@@ -80,19 +91,59 @@ int main(int argc, char** argv) {
 				if (!random_forest_cfg.lookupValue("max_depth", max_depth)) max_depth = DEFAULT_MAX_DEPTH;
 				if (!random_forest_cfg.lookupValue("min_sample_leaf", min_sample_leaf)) min_sample_leaf = DEFAULT_MIN_SAMPLE_LEAF;
 				if (!random_forest_cfg.lookupValue("criterion", criterion)) criterion = "sqrt";
+				if (!random_forest_cfg.lookupValue("max_bins", max_bins)) max_bins = DEFAULT_MAX_BINS;
+				if (!random_forest_cfg.lookupValue("splitter", splitter)) splitter = "best";
+				if (splitter == "best") {
+					split = BEST_SPLIT;
+				} else if (splitter == "histogram") {
+					split = HISTOGRAM_SPLIT;
+				} else if (splitter == "random") {
+					split = RANDOM_SPLIT;
+				} else {
+					std::cerr << error_msg("Bad value of `splitter` under `RandomForest`. Valid values are `best`, `histogram` and `random`.") << std::endl;
+					exit(EXIT_FAILURE);
+				}
+				if (!random_forest_cfg.lookupValue("grow", grow_order)) grow_order = "depth";
+				if (grow_order == "depth") {
+					grow = DEPTH_FIRST;
+				} else if (grow_order == "level") {
+					grow = LEVEL_WISE;
+				} else {
+					std::cerr << error_msg("Bad value of `grow` under `RandomForest`. Valid values are `depth` and `level`.") << std::endl;
+					exit(EXIT_FAILURE);
+				}
 
 				const libconfig::Setting& train_cfg = root["Train"];
 				if (!train_cfg.lookupValue("path", train_path)) {
 					std::cerr << error_msg("You must specify a training dataset path under `Train` in your configure file.");
 					exit(EXIT_FAILURE);
 				}
-				if (!train_cfg.lookupValue("n_classes", n_classes)) {
-					std::cerr << error_msg("You must give `n_classes` under `Train` in your configure file.");
-					exit(EXIT_FAILURE);
+				/* create dataset object */
+				d = new dataset();
+				has_n_classes = train_cfg.lookupValue("n_classes", n_classes);
+				has_n_features = train_cfg.lookupValue("n_features", n_features);
+				/* with hashed feature ids, the number of features is the number of buckets */
+				if (!train_cfg.lookupValue("hash_buckets", hash_buckets)) hash_buckets = 0;
+				if (hash_buckets > 0) {
+					d->set_feature_hash(hash_buckets);
+					n_features = hash_buckets;
+					has_n_features = true;
 				}
-				if (!train_cfg.lookupValue("n_features", n_features)) {
-					std::cerr << error_msg("You must give `n_features` under `Train` in your configure file.");
-					exit(EXIT_FAILURE);
+				if (!has_n_classes || !has_n_features) {
+					int cache_classes, cache_features;
+					bool shared = train_cfg.lookupValue("shared_name", shared_name);
+					/* the segment or cache loaded below has them in its header if it is up to date */
+					if ((shared || train_cfg.lookupValue("cache_path", cache_path))
+							&& dataset::read_cache_counts(shared ? shared_name : cache_path, shared, train_path, cache_classes, cache_features)
+							&& (!has_n_classes || cache_classes == n_classes) && (!has_n_features || cache_features == n_features)) {
+						n_classes = cache_classes;
+						n_features = cache_features;
+					} else {
+						/* find out the missing ones by a scan, which is reused by `load_data` */
+						d->load_data_meta(train_path, n_threads, read_format(train_cfg, "Train"));
+						if (!has_n_classes) n_classes = d->get_n_classes();
+						if (!has_n_features) n_features = d->get_n_features();
+					}
 				}
 				/* allocate space to weight vector */
 				weight = new float[n_classes];
@@ -115,15 +166,65 @@ int main(int argc, char** argv) {
 					for (c = 0; c < n_classes; c++) weight[c] /= weight_tot;
 				}
 
-				/* create dataset object */
-				d = new dataset(n_classes, n_features, weight);
-				d->load_data(train_path, TRAIN);
+				d->init(n_classes, n_features, weight);
+				if (!train_cfg.lookupValue("memory_budget", memory_budget)) memory_budget = 0;
+				if (memory_budget > 0 && !train_cfg.lookupValue("cache_path", cache_path)) {
+					std::cerr << error_msg("`memory_budget` under `Train` needs `cache_path` to keep the columns on disk.") << std::endl;
+					exit(EXIT_FAILURE);
+				}
+				if (memory_budget > 0 && train_cfg.lookupValue("shared_name", shared_name)) {
+					std::cerr << error_msg("`memory_budget` under `Train` can not be used with `shared_name`, the shared columns are always in memory.") << std::endl;
+					exit(EXIT_FAILURE);
+				}
+				if (train_cfg.lookupValue("shared_name", shared_name)) {
+					/* attach the column store published by another process, or build and publish it */
+					if (!d->attach_shared(shared_name, train_path)) {
+						d->load_data(train_path, TRAIN, n_threads, read_format(train_cfg, "Train"));
+						d->publish_shared(shared_name, train_path);
+					}
+				} else if (train_cfg.lookupValue("cache_path", cache_path)) {
+					/* map the binary cache, (re)build it from the text file if it is missing or out of date */
+					if (!d->load_cache(cache_path, train_path, (size_t)memory_budget << 20, n_threads)) {
+						/* out-of-core: build the columns in a file backed mapping, then train from the cache file only */
+						if (memory_budget > 0) d->set_spill_file(cache_path + ".spill");
+						d->load_data(train_path, TRAIN, n_threads, read_format(train_cfg, "Train"));
+						d->save_cache(cache_path, train_path);
+						if (memory_budget > 0) {
+							delete d;
+							d = new dataset(n_classes, n_features, weight);
+							d->set_feature_hash(hash_buckets);
+							if (!d->load_cache(cache_path, train_path, (size_t)memory_budget << 20, n_threads)) {
+								std::cerr << error_msg("Fail to open the cache file " + cache_path) << std::endl;
+								exit(EXIT_FAILURE);
+							}
+						}
+					}
+				} else {
+					d->load_data(train_path, TRAIN, n_threads, read_format(train_cfg, "Train"));
+				}
+				/* categorical features are split by sets of categories */
+				std::string categorical_str;
+				if (train_cfg.lookupValue("categorical", categorical_str)) {
+					std::stringstream ss(categorical_str);
+					std::string categorical_entry;
+					std::vector<int> categorical;
+					while (std::getline(ss, categorical_entry, ',')) 
+						categorical.push_back(atoi(categorical_entry.c_str()));
+					d->set_categorical(categorical);
+				}
+				/* a row major copy lets small nodes look up their examples instead of scanning columns, it costs memory */
+				if (train_cfg.lookupValue("rows", rows) && rows) d->build_rows();
+				/* compressed columns are decoded block by block while building */
+				if (train_cfg.lookupValue("compress", compress) && compress) d->compress(n_threads);
+				/* histogram split needs the quantized features */
+				if (split == HISTOGRAM_SPLIT) d->build_bins(max_bins, n_threads);
 
 				/* create random forest classifier object */
-				rf = new random_forest_classifier(criterion, max_depth, min_sample_leaf, n_trees, n_threads);
+				rf = new random_forest_classifier(criterion, max_depth, min_sample_leaf, n_trees, n_threads, 1, split, grow);
 
 				/* build forest */
 				rf->build(d);
+				d->print_pool_stats();
 			} else { /* model is from model file trained before */
 				const libconfig::Setting& input_model_cfg = root["Input_Model"];
 				/* create random forest classifier object */
@@ -176,14 +277,9 @@ int main(int argc, char** argv) {
 			}
 			
 			int n_features_v, n_classes_v; 
-			if (!validate_cfg.lookupValue("n_features", n_features_v)) {
-				std::cerr << error_msg("To avoid mistake, please give `n_features` under `Validate` in your configure file.") << std::endl;
-				exit(EXIT_FAILURE);
-			}
-			if (!validate_cfg.lookupValue("n_classes", n_classes_v)) {
-				std::cerr << error_msg("To avoid mistake, please give `n_classes` under `Validate` in your configure file.") << std::endl;
-				exit(EXIT_FAILURE);
-			}
+			/* if not given, use the values of the model */
+			if (!validate_cfg.lookupValue("n_features", n_features_v)) n_features_v = rf->get_n_features();
+			if (!validate_cfg.lookupValue("n_classes", n_classes_v)) n_classes_v = rf->get_n_classes();
 
 			n_classes = rf->get_n_classes();
 			if (n_classes_v != n_classes) {
@@ -198,16 +294,20 @@ int main(int argc, char** argv) {
 			}
 
 			/* read validate data */
-			data_reader* dr = new data_reader(validate_path, n_features_v, TRAIN);
-			std::vector<example_t*> validate_data = dr->read_examples();
+			data_reader* dr = new data_reader(validate_path, n_features_v, TRAIN, read_format(validate_cfg, "Validate"));
+			/* hash the feature ids as the training set, then only the features used by the model are needed */
+			dr->set_feature_hash(rf->get_feature_hash());
+			dr->set_feature_filter(rf->get_used_features());
+			example_batch validate_data;
+			dr->read_examples(validate_data, n_threads);
 
 			/* validate model */
-			int n_validate = validate_data.size();	
+			int n_validate = validate_data.get_n_examples();	
 			float* proba_all = rf->predict_proba(validate_data);
 			float* proba = proba_all + n_validate;
 			int* label = new int[n_validate];
 			for (int i = 0; i < n_validate; i++) {
-				label[i] = validate_data[i]->y;
+				label[i] = validate_data.y[i];
 			}
 			
 			/* output performance report */
@@ -246,14 +346,9 @@ int main(int argc, char** argv) {
 
 			/* read dataset parameters */
 			int n_features_t, n_classes_t; 
-			if (!test_cfg.lookupValue("n_features", n_features_t)) {
-				std::cerr << error_msg("To avoid mistake, please give `n_features` under `Test` in your configure file.") << std::endl;
-				exit(EXIT_FAILURE);
-			}
-			if (!test_cfg.lookupValue("n_classes", n_classes_t)) {
-				std::cerr << error_msg("To avoid mistake, please give `n_classes` under `Test` in your configure file.") << std::endl;
-				exit(EXIT_FAILURE);
-			}
+			/* if not given, use the values of the model */
+			if (!test_cfg.lookupValue("n_features", n_features_t)) n_features_t = rf->get_n_features();
+			if (!test_cfg.lookupValue("n_classes", n_classes_t)) n_classes_t = rf->get_n_classes();
 			/* check dataset parameters whether are match which model */
 			n_classes = rf->get_n_classes();
 			if (n_classes_t != n_classes) {
@@ -267,13 +362,17 @@ int main(int argc, char** argv) {
 			}
 
 			/* read test data */
-			data_reader* dr = new data_reader(test_path, n_features_t, TEST);
-			std::vector<example_t*> test_data = dr->read_examples();
+			data_reader* dr = new data_reader(test_path, n_features_t, TEST, read_format(test_cfg, "Test"));
+			/* hash the feature ids as the training set, then only the features used by the model are needed */
+			dr->set_feature_hash(rf->get_feature_hash());
+			dr->set_feature_filter(rf->get_used_features());
+			example_batch test_data;
+			dr->read_examples(test_data, n_threads);
 
 			/* validate model */
-			int n_test = test_data.size();	
+			int n_test = test_data.get_n_examples();	
 			float* proba_all = rf->predict_proba(test_data);
-			float* proba = proba + n_test;
+			float* proba = proba_all + n_test;
 
 			/* read result path */
 			std::string result_path;
@@ -0,0 +1,123 @@
+/**
+ * @file scheduler.cpp
+ * @brief work-stealing task scheduler
+ * @version 1.0
+ * @date 2026-10-18
+ */
+#include "scheduler.h"
+
+/* the scheduler and the worker id of the calling thread, a thread belongs to one scheduler at most */
+static thread_local task_scheduler* cur_scheduler = nullptr;
+static thread_local int cur_worker = 0;
+
+task_scheduler::task_scheduler(int n_threads) {
+	if (n_threads <= 0) n_threads = std::max(1u, std::thread::hardware_concurrency());
+
+	this->n_queued = 0;
+	this->stop = false;
+	for (int w = 0; w < n_threads; w++) workers.push_back(new worker_t);
+	for (int w = 1; w < n_threads; w++) {
+		threads.push_back(std::thread([this, w]() {
+			work(w);
+		}));
+	}
+}
+
+task_scheduler::~task_scheduler() {
+	{
+		std::lock_guard<std::mutex> lk(idle_lock);
+		stop = true;
+	}
+	idle.notify_all();
+	for (int i = 0; i < (int)threads.size(); i++) threads[i].join();
+	for (int w = 0; w < (int)workers.size(); w++) delete workers[w];
+}
+
+int task_scheduler::get_n_workers() {
+	return workers.size();
+}
+
+int task_scheduler::current_worker() {
+	return cur_scheduler == this ? cur_worker : 0;
+}
+
+void task_scheduler::spawn(std::function<void()> task, std::atomic<int>& pending) {
+	worker_t* self = workers[current_worker()];
+
+	pending++;
+	{
+		std::lock_guard<std::mutex> lk(self->lock);
+		self->tasks.push_back([this, task, &pending]() {
+			task();
+			pending--;
+			/* `pending` may be gone once it drops to 0, only the scheduler is touched from here */
+			{
+				std::lock_guard<std::mutex> lk(idle_lock);
+			}
+			done.notify_all();
+		});
+	}
+	n_queued++;
+	/* an idle or waiting worker checks `n_queued` under `idle_lock`, so taking it here means the wake up is not lost */
+	{
+		std::lock_guard<std::mutex> lk(idle_lock);
+	}
+	idle.notify_one();
+	done.notify_all();
+}
+
+void task_scheduler::wait(std::atomic<int>& pending) {
+	int w = current_worker();
+
+	while (pending > 0) {
+		if (run_one(w)) continue;
+
+		/* the remaining tasks run on other workers, sleep until one of them returns or a new task is queued */
+		std::unique_lock<std::mutex> lk(idle_lock);
+		done.wait(lk, [this, &pending]() {
+			return pending == 0 || n_queued > 0;
+		});
+	}
+}
+
+bool task_scheduler::run_one(int w) {
+	std::function<void()> task;
+	worker_t* victim;
+	int n_workers = workers.size();
+	bool found = false;
+
+	/* the own deque from the newest, then the others from the oldest */
+	for (int k = 0; k < n_workers && !found; k++) {
+		victim = workers[(w + k) % n_workers];
+		std::lock_guard<std::mutex> lk(victim->lock);
+		if (victim->tasks.empty()) continue;
+		if (k == 0) {
+			task = std::move(victim->tasks.back());
+			victim->tasks.pop_back();
+		} else {
+			task = std::move(victim->tasks.front());
+			victim->tasks.pop_front();
+		}
+		found = true;
+	}
+	if (!found) return false;
+
+	n_queued--;
+	task();
+	return true;
+}
+
+void task_scheduler::work(int w) {
+	cur_scheduler = this;
+	cur_worker = w;
+
+	while (true) {
+		if (run_one(w)) continue;
+
+		std::unique_lock<std::mutex> lk(idle_lock);
+		idle.wait(lk, [this]() {
+			return stop || n_queued > 0;
+		});
+		if (stop) break;
+	}
+}
@@ -11,6 +11,8 @@ node::node(int n_classes) {
 	this->is_cate = false;
 	this->feature_id = -1;
 	this->threshold = (feature_t)0.0;
+	this->n_cate_words = 0;
+	this->cate_set = nullptr;
 	this->gain = 0.0;
 	this->n_classes = n_classes;
 
@@ -25,6 +27,10 @@ node::~node() {
 		delete[] cur_frequency;
 		cur_frequency = nullptr;
 	}
+	if (cate_set != nullptr) {
+		delete[] cate_set;
+		cate_set = nullptr;
+	}
 }
 
 void node::dump(const std::string& filename) {
@@ -50,6 +56,10 @@ void node::dump(std::ofstream& out) {
 		out.write((char*)&this->threshold, sizeof(feature_t));
 		out.write((char*)&this->gain, sizeof(float));
 		out.write((char*)&this->n_classes, sizeof(int));
+		if (this->is_cate) {
+			out.write((char*)&this->n_cate_words, sizeof(int));
+			out.write((char*)this->cate_set, sizeof(unsigned int)*this->n_cate_words);
+		}
 	} else {
 		out.write((char*)&this->n_classes, sizeof(int));
 		out.write((char*)this->cur_frequency, sizeof(float)*this->n_classes);
@@ -79,6 +89,11 @@ void node::load(std::ifstream& in) {
 		in.read((char*)&this->threshold, sizeof(feature_t));
 		in.read((char*)&this->gain, sizeof(float));
 		in.read((char*)&this->n_classes, sizeof(int));
+		if (this->is_cate) {
+			in.read((char*)&this->n_cate_words, sizeof(int));
+			this->cate_set = new unsigned int[this->n_cate_words];
+			in.read((char*)this->cate_set, sizeof(unsigned int)*this->n_cate_words);
+		}
 	} else {
 		in.read((char*)&this->n_classes, sizeof(int));
 		in.read((char*)this->cur_frequency, sizeof(float)*this->n_classes);
@@ -92,8 +107,14 @@ void node::print_info() {
 				  << "*** Internal Node ***" << std::endl
 				  << "is_cate: " << std::boolalpha << this->is_cate << std::endl
 				  << "feature_id: " << this->feature_id << std::endl
-				  << "threshold: " << this->threshold << std::endl
-				  << "gain: " << this->gain << std::endl
+				  << "threshold: " << this->threshold << std::endl;
+		if (this->is_cate) {
+			std::cout << "categories to left:";
+			for (int k = 0; k < 32*this->n_cate_words; k++) 
+				if (go_left(k)) std::cout << " " << k;
+			std::cout << std::endl;
+		}
+		std::cout << "gain: " << this->gain << std::endl
 				  << "n_classes: " << this->n_classes << std::endl
 				  << "leaf_idx: " << this->leaf_idx << std::endl;
 	} else {
@@ -107,16 +128,47 @@ void node::print_info() {
 	}
 }
 
+bool node::go_left(feature_t v) const {
+	int k;
+	if (this->is_cate) {
+		k = (int)v;
+		return k >= 0 && k < 32*this->n_cate_words && (this->cate_set[k >> 5] >> (k & 31) & 1);
+	}
+	return v <= this->threshold;
+}
+
+bool node::zero_left() const {
+	/* the same test as the prediction, so a threshold of exactly 0 sends the zeros left in both */
+	return go_left(0);
+}
+
+void node::set_categories(const unsigned int* cate_set, int n_cate_words) {
+	if (this->cate_set != nullptr) delete[] this->cate_set;
+	this->is_cate = true;
+	this->n_cate_words = n_cate_words;
+	this->cate_set = new unsigned int[n_cate_words];
+	memcpy(this->cate_set, cate_set, sizeof(unsigned int)*n_cate_words);
+}
+
 batch_node::batch_node(int n_classes) : node(n_classes) {
 
 }
 
 tree::tree() {
-			
+	/* `load` fills the tree, it must not free anything which is not allocated */
+	this->root = nullptr;
+	this->leaf_pt = nullptr;
+	this->leaf_size = 0;
+	this->fea_imp = nullptr;
+	this->sample = nullptr;
+	this->in_node = nullptr;
+	this->n_threads = 1;
+	this->sched = nullptr;
+	this->workspace = nullptr;
 }
 
-tree::tree(std::string feature_rule, int max_depth, int min_split, int verbose) {
-	init(feature_rule, max_depth, min_split, verbose);
+tree::tree(std::string feature_rule, int max_depth, int min_split, int verbose, split_mode split, grow_mode grow, int n_threads) {
+	init(feature_rule, max_depth, min_split, verbose, split, grow, n_threads);
 }
 
 tree::~tree() {
@@ -125,20 +177,28 @@ tree::~tree() {
 		delete[] leaf_pt;
 		leaf_pt = nullptr;
 	}
-	if (valid != nullptr) {
-		delete[] valid;
-		valid = nullptr;
+	if (sample != nullptr) {
+		delete[] sample;
+		delete[] in_node;
+		sample = nullptr;
+		in_node = nullptr;
 	}
 }
 
-void tree::init(std::string feature_rule, int max_depth, int min_split, int verbose) {
+void tree::init(std::string feature_rule, int max_depth, int min_split, int verbose, split_mode split, grow_mode grow, int n_threads) {
 	this->feature_rule = feature_rule;
 	this->max_depth = max_depth;
 	this->min_split = min_split;
+	this->split = split;
+	this->grow = grow;
+	this->n_threads = std::max(1, n_threads);
+	this->sched = nullptr;
+	this->workspace = nullptr;
 	this->leaf_pt = new node*[1];
 	this->leaf_size = 0;
 	this->fea_imp = nullptr;
-	this->valid = nullptr;
+	this->sample = nullptr;
+	this->in_node = nullptr;
 	this->verbose = verbose;
 
 	/* set root node to nullptr */
@@ -168,11 +228,15 @@ void tree::check_build() {
 	}
 }
 
-//int* tree::apply(example_t* examples, int size) {
 int* tree::apply(std::vector<example_t*> &examples) {
+	example_batch batch(examples);
+	return apply(batch);
+}
+
+int* tree::apply(example_batch &examples) {
 	feature_t *feature_vec;
-	example_t *ex;
-	int* ret, size = examples.size();
+	int* ret, size = examples.get_n_examples();
+	size_t begin, end;
 	node* cur_node;
 	
 
@@ -182,40 +246,39 @@ int* tree::apply(std::vector<example_t*> &examples) {
 	ret = new int[size];
 
 	for (int i = 0; i < size; i++) {
-		ex = examples[i];
-		for (int j = 0; j < ex->nnz; j++) feature_vec[ex->fea_id[j]] = ex->fea_value[j];
+		begin = examples.row_ptr[i];
+		end = examples.row_ptr[i+1];
+		for (size_t j = begin; j < end; j++) feature_vec[examples.fea_id[j]] = examples.fea_value[j];
 		cur_node = this->root;	
 		/* go down the tree */
 		while (cur_node->leaf_idx == -1) {
-			if (cur_node->is_cate) { // split feature is categorical
-				if (feature_vec[cur_node->feature_id] == cur_node->threshold) {
-					cur_node = cur_node->left;
-				} else {
-					cur_node = cur_node->right;
-				}
-			} else { // split feature is continuous
-				if (feature_vec[cur_node->feature_id] <= cur_node->threshold) {
-					cur_node = cur_node->left;
-				} else {
-					cur_node = cur_node->right;
-				}
+			/* a categorical split tests the category set, a continuous one the threshold */
+			if (cur_node->go_left(feature_vec[cur_node->feature_id])) {
+				cur_node = cur_node->left;
+			} else {
+				cur_node = cur_node->right;
 			}
 		}
 		ret[i] = cur_node->leaf_idx;
 
 		/* modify back */
-		for (int j = 0; j < ex->nnz; j++) feature_vec[ex->fea_id[j]] = 0.0;
+		for (size_t j = begin; j < end; j++) feature_vec[examples.fea_id[j]] = 0.0;
 	}
 
 	if (feature_vec != nullptr) {
-		delete feature_vec;
+		delete[] feature_vec;
 		feature_vec = nullptr;
 	}
 	return ret;
 }
 
 int* tree::predict_label(std::vector<example_t*> &examples) {
-	int *predict_leaf_idx, label, *ret, size = examples.size();
+	example_batch batch(examples);
+	return predict_label(batch);
+}
+
+int* tree::predict_label(example_batch &examples) {
+	int *predict_leaf_idx, label, *ret, size = examples.get_n_examples();
 	node* leaf_node;
 	float max_proba;
 
@@ -234,9 +297,15 @@ int* tree::predict_label(std::vector<example_t*> &examples) {
 		}
 		ret[i] = label;
 	}
+	delete[] predict_leaf_idx;
 	return ret;
 }
 
+float* tree::predict_proba(std::vector<example_t*> &examples) {
+	example_batch batch(examples);
+	return predict_proba(batch);
+}
+
 /*
  * Return Vector Format Example:
  *
@@ -247,8 +316,8 @@ int* tree::predict_label(std::vector<example_t*> &examples) {
  *
  * return [0.8, 0.9, 0.3, 0.2, 0.1, 0.7]
  */
-float* tree::predict_proba(std::vector<example_t*> &examples) {
-	int *predict_leaf_idx, size = examples.size();
+float* tree::predict_proba(example_batch &examples) {
+	int *predict_leaf_idx, size = examples.get_n_examples();
 	node* leaf_node;
 	float* ret;
 
@@ -265,6 +334,7 @@ float* tree::predict_proba(std::vector<example_t*> &examples) {
 		}
 		//memcpy(ret[i], leaf_node->cur_frequency, sizeof(float)*this->n_classes);
 	}
+	delete[] predict_leaf_idx;
 	return ret;
 }
 
@@ -364,12 +434,19 @@ void tree::export_dotfile(std::ofstream& ofs, int& node_idx, bool need_header_fo
 			ofs << "]\", shape=\"box\"];" << std::endl;
         } else { /* internal node */
             if (c_node->is_cate) {
-                ofs << node_idx << " [label=\"X[" << c_node->feature_id << "] = ";
+                ofs << node_idx << " [label=\"X[" << c_node->feature_id << "] in {";
+				for (int k = 0, first = 1; k < 32*c_node->n_cate_words; k++) {
+					if (!c_node->go_left(k)) continue;
+					ofs << (first ? "" : ",") << k;
+					first = 0;
+				}
+				ofs << "}";
             } else {
-                ofs << node_idx << " [label=\"X[" << c_node->feature_id << "] <= ";
+                ofs << node_idx << " [label=\"X[" << c_node->feature_id << "] <= "
+					<< std::fixed << std::setprecision(3) << c_node->threshold;
             }
-			ofs	<< std::fixed << std::setprecision(3) << c_node->threshold << "\\ngain= "
-				<< std::setprecision(3) << c_node->gain<< "\", shape=\"box\"];"
+			ofs	<< "\\ngain= "
+				<< std::fixed << std::setprecision(3) << c_node->gain<< "\", shape=\"box\"];"
 				<< std::endl;
 			/* push left node and right node to stack */
 			st.push(c_node->right);
@@ -385,6 +462,7 @@ void tree::export_dotfile(std::ofstream& ofs, int& node_idx, bool need_header_fo
 }
 
 int tree::add_leaf(node *leaf) {
+	std::lock_guard<std::mutex> lk(leaf_lock);
 	leaf_pt = (node**)realloc(this->leaf_pt, sizeof(node*)*(this->leaf_size+1));	
 	leaf_pt[this->leaf_size] = leaf;
 	this->leaf_size++;
@@ -400,6 +478,50 @@ int tree::get_n_features() {
 	return this->n_features;
 }
 
+int tree::get_n_threads() {
+	return this->n_threads;
+}
+
+task_scheduler* tree::get_scheduler() {
+	return this->sched;
+}
+
+void tree::set_scheduler(task_scheduler* sched) {
+	this->sched = sched;
+}
+
+void tree::set_workspace(split_workspace** workspace) {
+	this->workspace = workspace;
+}
+
+int tree::stamp_of(int ex) const {
+	return in_node[ex].load(std::memory_order_relaxed);
+}
+
+void tree::set_stamp(int ex, int stamp) {
+	in_node[ex].store(stamp, std::memory_order_relaxed);
+}
+
+void tree::mark_used_features(bool* used) {
+	std::stack<node*> st;
+	node* c_node;
+
+	/* check if the tree has been built */
+	check_build();
+
+	st.push(root);
+	while (!st.empty()) {
+		c_node = st.top();
+		st.pop();
+
+		if (c_node->leaf_idx == -1) {
+			used[c_node->feature_id] = true;
+			st.push(c_node->right);
+			st.push(c_node->left);
+		}
+	}
+}
+
 int tree::get_leaf_size() {
 	return this->leaf_size;
 }
@@ -485,7 +607,7 @@ void decision_tree::load(const std::string& filename) {
 	in.clear();
 }
 
-decision_tree::decision_tree(const std::string feature_rule, int max_depth, int min_split, int verbose) : tree(feature_rule, max_depth, min_split, verbose) {
+decision_tree::decision_tree(const std::string feature_rule, int max_depth, int min_split, int verbose, split_mode split, grow_mode grow, int n_threads) : tree(feature_rule, max_depth, min_split, verbose, split, grow, n_threads) {
 
 }
 
@@ -493,14 +615,21 @@ void decision_tree::build(dataset*& d) {
 	target_t c; /* temporary variable to indicate current class */
 	node* c_node;
 	int n_classes = d->get_n_classes(), n_examples = d->get_n_examples(), n_features = d->get_n_features();
-	int ex_id;
+	int ex_id, n_workspaces = 0;
 	float nf_t;
+	split_workspace** own_workspace = nullptr;
+	task_scheduler* own_sched = nullptr;
 	m_timer* ti = new m_timer();
 
 	/* set `n_features` and `n_classes` */
 	this->n_features = n_features;
 	this->n_classes = n_classes;
 
+	if (this->split == HISTOGRAM_SPLIT && !d->is_binned()) {
+		std::cerr << "Please call `build_bins` of the dataset before building tree with `HISTOGRAM_SPLIT`" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
 	/* determine `max_feature` */
 	if (feature_rule == "sqrt") {
 		this->max_feature = (int)sqrt((double)n_features);
@@ -519,7 +648,9 @@ void decision_tree::build(dataset*& d) {
 		}
 	}
 
-	this->valid = new int[n_examples];
+	this->sample = new int[n_examples];
+	this->in_node = new std::atomic<int>[n_examples]();
+	this->node_stamp = 0;
 
 	/* allocate space to root node */	
 	root = new batch_node(n_classes);
@@ -530,28 +661,72 @@ void decision_tree::build(dataset*& d) {
 		c = d->y[ex_id];
 		root->cur_frequency[c] += d->weight[c];
 
-		/* set the chosen to be valid */
-		this->valid[ex_id] = 1; 
+		/* the root owns all the examples */
+		this->sample[i] = ex_id; 
+	}
+
+	/* a tree built alone makes its workers and their workspaces, a forest gives the ones shared by its trees */
+	if (this->grow == DEPTH_FIRST && this->sched == nullptr && this->n_threads > 1) {
+		own_sched = new task_scheduler(this->n_threads);
+		this->sched = own_sched;
+	}
+	if (this->grow == DEPTH_FIRST && this->workspace == nullptr) {
+		n_workspaces = sched != nullptr ? sched->get_n_workers() : 1;
+		own_workspace = new split_workspace*[n_workspaces];
+		for (int w = 0; w < n_workspaces; w++) own_workspace[w] = new split_workspace(this->split, n_classes);
+		this->workspace = own_workspace;
 	}
 
 	if (verbose >= 1)
 		ti->tic("Start build tree");	
 
-	/* revursively build tree */
-	build_rec(this->root, d, 0);
+	/* revursively build tree, or a level at a time */
+	if (this->grow == LEVEL_WISE) 
+		build_level(d);
+	else
+		build_rec(this->root, d, 0, n_examples, 0);
+
+	if (own_workspace != nullptr) {
+		for (int w = 0; w < n_workspaces; w++) delete own_workspace[w];
+		delete[] own_workspace;
+		this->workspace = nullptr;
+	}
+	if (own_sched != nullptr) {
+		delete own_sched;
+		this->sched = nullptr;
+	}
 
 	if (verbose >= 1)
 		ti->toc("\nBuild tree done.");
 
+	/* the partition is only needed while building */
+	delete[] this->sample;
+	delete[] this->in_node;
+	this->sample = nullptr;
+	this->in_node = nullptr;
+
 	//[> print a dot on the screen <]
 	//std::cout << ".";
 }
 
-void decision_tree::build_rec(node*& root, dataset*& d, int depth) {
-	int n_classes = d->get_n_classes(), n_examples = d->get_n_examples(), count, tot_ex, left_tot_ex, right_tot_ex;
-	splitter* s = new best_splitter(n_classes);			
-	ev_pair_t *p;	
-	node *first, *second;
+void decision_tree::build_rec(node*& root, dataset*& d, int begin, int end, int depth, bool is_second) {
+	int n_classes = d->get_n_classes(), count, tot_ex, left_tot_ex, right_tot_ex, mid;
+	/* the workspace of this worker is free again once the examples are partitioned, so the children 
+	 * (and whatever the worker runs while waiting for them) reuse it */
+	split_workspace* ws = workspace[sched != nullptr ? sched->current_worker() : 0]->acquire();
+	splitter* s = ws->s;
+	criterion* cr = ws->cr;
+
+	s->reset();
+	if (this->split == HISTOGRAM_SPLIT) {
+		if ((int)hist_stack.size() <= depth) hist_stack.resize(depth+1);
+		/* a first child which turns out to be a leaf must not leave stale histograms to its sibling */
+		if (!is_second) hist_stack[depth].clear();
+		static_cast<hist_splitter*>(s)->set_histograms(&hist_stack[depth], depth > 0 ? &hist_stack[depth-1] : nullptr, is_second ? &hist_stack[depth] : nullptr);
+	}
+
+	/* everything below is proportional to the examples of this node */
+	enter_node(s, begin, end);
 
 	/* 1. check if reach to leaf */
 	//if (depth >= this->max_depth) return; /* check depth */
@@ -570,26 +745,17 @@ void decision_tree::build_rec(node*& root, dataset*& d, int depth) {
 			std::cout << "Different Class: " << count << std::endl;
 			std::cout << "Total Example: " << tot_ex << std::endl;
 			std::cout << "Valid Example: " << std::endl;
-			for (int i = 0; i < n_examples; i++) {
-				if (this->valid[i] > 0) {
-					std::cout << "#" << i << ":" << d->y[i] << " ";
-				}	
-			}
+			for (int i = begin; i < end; i++) 
+				std::cout << "#" << sample[i] << ":" << d->y[sample[i]] << " ";
 			std::cout << std::endl << std::endl;
 		}
-		
-		/* normalize */
-		float tot_frequency = 0.0;
-		for (int c = 0; c < root->n_classes; c++) tot_frequency += root->cur_frequency[c];
-		for (int c = 0; c < root->n_classes; c++) root->cur_frequency[c] /= tot_frequency;
 
-		/* attach this node to leaf node group */
-		root->leaf_idx = add_leaf(root);
+		ws->release();
+		make_leaf(root);
 		return;
 	}
 
 	/* 2. make a split */
-	criterion* cr = new gini(root->cur_frequency, n_classes);
 	s->split(this, root, d, cr);
 	
 	// can't split any more
@@ -600,31 +766,20 @@ void decision_tree::build_rec(node*& root, dataset*& d, int depth) {
 			std::cout << "Different Class: " << count << std::endl;
 			std::cout << "Total Example: " << tot_ex << std::endl;
 			std::cout << "Valid Example: " << std::endl;
-			for (int i = 0; i < n_examples; i++) {
-				if (this->valid[i] > 0) {
-					std::cout << "#" << i << ":" << d->y[i] << " ";
-				}	
-			}
+			for (int i = begin; i < end; i++) 
+				std::cout << "#" << sample[i] << ":" << d->y[sample[i]] << " ";
 			std::cout << std::endl << std::endl;
 		}
-		
-		/* normalize */
-		float tot_frequency = 0.0;
-		for (int c = 0; c < root->n_classes; c++) tot_frequency += root->cur_frequency[c];
-		for (int c = 0; c < root->n_classes; c++) root->cur_frequency[c] /= tot_frequency;
 
-		/* attach this node to leaf node group */
-		root->leaf_idx = add_leaf(root);
-		if (cr != nullptr) {
-			delete cr;
-			cr = nullptr;
-		}
+		ws->release();
+		make_leaf(root);
 		return;
 	}
 
 	root->feature_id = s->fea_id;
 	root->is_cate = d->is_cate[s->fea_id];
 	root->threshold = s->threshold;
+	if (root->is_cate) root->set_categories(s->cate_set.data(), s->cate_set.size());
 	root->gain = s->gain;
 	root->n_classes = n_classes;
 	root->leaf_idx = -1; /* indicate this node is not a leaf node */
@@ -633,88 +788,362 @@ void decision_tree::build_rec(node*& root, dataset*& d, int depth) {
 	root->right = new batch_node(n_classes);
 	memcpy(root->right->cur_frequency, s->right_frequency, sizeof(float)*n_classes);
 
-	if (this->verbose >= 2) {
-		std::cout << "=================================" << std::endl;
-		std::cout << "Depth: " << depth << std::endl;
-		std::cout << "Total Examples: " << tot_ex << std::endl;
-		std::cout << "Split Feature: " << s->fea_id << " "
-				  << "Threshold: " << s->threshold << std::endl;
-		std::cout << "Valid Example: " << std::endl;
-		for (int i = 0; i < n_examples; i++) {
-			if (this->valid[i] > 0) {
-				std::cout << "#" << i << ":" << d->y[i] << " ";
+	if (this->verbose >= 2) print_split(d, s, depth, tot_ex);
+
+	/* examples of the left child are moved to sample[begin, mid), the right child gets sample[mid, end) */
+	mid = partition(d, root, s);
+	ws->release();
+
+	/* build the node contains 0 examples first, then the second one */
+	if (root->zero_left()) { /* 0s are in left */
+		build_children(d, root->left, begin, mid, root->right, mid, end, depth+1);
+	} else {				/* 0s are in right */
+		build_children(d, root->right, mid, end, root->left, begin, mid, depth+1);
+	}
+}
+
+void decision_tree::build_children(dataset*& d, node*& first, int first_begin, int first_end, node*& second, int second_begin, int second_end, int depth) {
+	std::atomic<int> pending(0);
+
+	/* the histograms of a second child are derived from its sibling's, so they are built in order */
+	if (sched == nullptr || this->split == HISTOGRAM_SPLIT || second_end - second_begin < TASK_MIN_EXAMPLES) {
+		build_rec(first, d, first_begin, first_end, depth);
+		build_rec(second, d, second_begin, second_end, depth, true);
+		return;
+	}
+
+	/* the children own disjoint ranges of `sample`, the second one waits in the deque of this worker 
+	 * (and is taken back by it if no other worker steals it meanwhile) */
+	sched->spawn([&]() {
+		build_rec(second, d, second_begin, second_end, depth, true);
+	}, pending);
+	build_rec(first, d, first_begin, first_end, depth);
+	sched->wait(pending);
+}
+
+void decision_tree::build_level(dataset*& d) {
+	std::vector<level_node_t> level, next;
+	std::vector<int> mid;
+	std::vector<best_splitter*> pool; 	/* pool[k] splits the k-th node of every level */
+	std::vector<criterion*> pool_cr;
+	level_node_t ln;
+	node* nd;
+	best_splitter* s;
+	int n_classes = d->get_n_classes(), n_examples = d->get_n_examples(), count, tot_ex, n_open;
+	int* node_of = new int[n_examples];
+	/* buffers of split_level, allocated once and reused by every level */
+	ev_pair_t* view = new ev_pair_t[n_examples];
+	std::vector<float> hist;
+
+	ln.nd = this->root;
+	ln.begin = 0;
+	ln.end = n_examples;
+	level.push_back(ln);
+	for (int depth = 0; !level.empty(); depth++) {
+		/* 1. check if reach to leaf, the others are kept in `level` and their examples are numbered */
+		n_open = 0;
+		for (int k = 0; k < (int)level.size(); k++) {
+			nd = level[k].nd;
+			count = tot_ex = 0;
+			for (int c = 0; c < n_classes; c++) {
+				tot_ex += nd->cur_frequency[c] / d->weight[c];
+				if (nd->cur_frequency[c] >= 1e-5) {
+					count++;
+				}
+			}
+			if ((this->max_depth > 0 && depth >= this->max_depth) || count < 2 || tot_ex <= this->min_split) {
+				make_leaf(nd);
+				for (int i = level[k].begin; i < level[k].end; i++) node_of[sample[i]] = -1;
+				continue;
+			}
+			for (int i = level[k].begin; i < level[k].end; i++) node_of[sample[i]] = n_open;
+			level[n_open++] = level[k];
+		}
+		level.resize(n_open);
+		if (level.empty()) break;
+
+		if (this->verbose >= 2) 
+			std::cout << "Depth: " << depth << ", " << level.size() << " nodes to split" << std::endl;
+
+		/* 2. make the splits of the whole level */
+		for (int k = 0; k < (int)level.size(); k++) {
+			if (k == (int)pool.size()) {
+				pool.push_back(this->split == RANDOM_SPLIT ? new random_splitter(n_classes) : new best_splitter(n_classes));
+				pool_cr.push_back(new gini());
 			}
+			level[k].s = pool[k];
+			level[k].s->reset();
+			level[k].cr = pool_cr[k];
+			level[k].cr->set_current(level[k].nd->cur_frequency, n_classes);
+			level[k].candidate = level[k].s->sample_features(this, d, level[k].n_candidates);
 		}
-		std::cout << std::endl;
-		std::cout << "Nonzero Values: " << std::endl;	
-		for (int i = 0; i < d->size[s->fea_id]; i++) {
-			if (this->valid[d->x[s->fea_id][i].ex_id] > 0)
-				std::cout << d->x[s->fea_id][i].ex_id << ":"
-					<< d->x[s->fea_id][i].fea_value << " ";
+		split_level(d, level, node_of, view, hist);
+
+		/* 3. nodes which can not be split any more are leaves, the others move their examples to the children */
+		for (int k = 0; k < (int)level.size(); k++) {
+			nd = level[k].nd;
+			s = level[k].s;
+			if (s->fea_id == -1) {
+				make_leaf(nd);
+				for (int i = level[k].begin; i < level[k].end; i++) node_of[sample[i]] = -1;
+				continue;
+			}
+			nd->feature_id = s->fea_id;
+			nd->is_cate = d->is_cate[s->fea_id];
+			nd->threshold = s->threshold;
+			if (nd->is_cate) nd->set_categories(s->cate_set.data(), s->cate_set.size());
+			nd->gain = s->gain;
+			nd->n_classes = n_classes;
+			nd->leaf_idx = -1; /* indicate this node is not a leaf node */
+			nd->left = new batch_node(n_classes);
+			memcpy(nd->left->cur_frequency, s->left_frequency, sizeof(float)*n_classes);
+			nd->right = new batch_node(n_classes);
+			memcpy(nd->right->cur_frequency, s->right_frequency, sizeof(float)*n_classes);
 		}
-		std::cout << std::endl << std::endl;
+		partition_level(d, level, node_of, mid);
+
+		next.clear();
+		for (int k = 0; k < (int)level.size(); k++) {
+			nd = level[k].nd;
+			if (level[k].s->fea_id != -1) {
+				ln.nd = nd->left;
+				ln.begin = level[k].begin;
+				ln.end = mid[k];
+				next.push_back(ln);
+				ln.nd = nd->right;
+				ln.begin = mid[k];
+				ln.end = level[k].end;
+				next.push_back(ln);
+			}
+		}
+		level.swap(next);
 	}
-	
-	/* find the first example index in x[s->fea_id] which is large than threshold */
-	p = d->x[s->fea_id];
-	int l, k, u, m;
-	k = 0;
-	u = d->size[s->fea_id];
-	while (k < u) {
-		m = (k + u) / 2;	
-		if (p[m].fea_value > s->threshold)
-			u = m;
-		else 
-			k = m + 1;
-	}
-	/* build the node contains 0 examples first */
-	if (s->threshold > 0) { /* 0s are in left */
-		/* examples between l and u are in right */
-		l = k;
-		u = d->size[s->fea_id];
-		first = root->left;
-		second = root->right;
-	} else {				/* 0s are in right */
-		/* examples between l and u are in left */
-		l = 0;
-		u = k;
-		first = root->right;
-		second = root->left;
+
+	for (int k = 0; k < (int)pool.size(); k++) {
+		delete pool[k];
+		delete pool_cr[k];
 	}
+	delete[] node_of;
+	delete[] view;
+}
+
+void decision_tree::split_level(dataset*& d, std::vector<level_node_t>& level, const int* node_of, ev_pair_t* view, std::vector<float>& hist) {
+	std::vector<std::pair<int, int> > wanted; /* (feature, node) for every candidate feature of every node */
+	ev_pair_t* buf = new ev_pair_t[COLUMN_BLOCK_SIZE];
+	const ev_pair_t* x;
+	const unsigned char* bin;
+	float *h, nonzero;
+	int n_classes = d->get_n_classes(), n_nodes = level.size(), n_wanted, f, nb, n, k, c, cur_ex, first, last;
+	int* slot = new int[n_nodes]; 	/* slot[k] is the place of node `k` among the nodes testing the current feature, -1 if it does not */
+	int* n_entries = new int[n_nodes];
+
+	for (k = 0; k < n_nodes; k++) {
+		slot[k] = -1;
+		for (int i = 0; i < level[k].n_candidates; i++) 
+			wanted.push_back(std::make_pair(level[k].candidate[i], k));
+	}
+	std::sort(wanted.begin(), wanted.end());
+	n_wanted = wanted.size();
+
+	/* node `k` collects its entries of the current column in view[begin, end), in column order, so they are sorted */
+	for (first = 0; first < n_wanted; first = last) {
+		f = wanted[first].first;
+		for (last = first; last < n_wanted && wanted[last].first == f; last++) 
+			slot[wanted[last].second] = last - first;
+		/* categories are not binned, their frequency tables are built from the entries */
+		if (this->split == HISTOGRAM_SPLIT && !d->is_cate[f]) {
+			/* one pass over the column builds the histograms of non-zero examples of all the nodes */
+			nb = d->n_bins[f];
+			hist.assign((size_t)(last - first)*nb*n_classes, 0.0);
+			for (int b = 0; b < d->get_n_blocks(f); b++) {
+				x = d->get_block(f, b, buf, n);
+				bin = d->bin[f] + b*COLUMN_BLOCK_SIZE;
+				for (int j = 0; j < n; j++) {
+					cur_ex = x[j].ex_id;
+					k = node_of[cur_ex];
+					if (k < 0 || slot[k] < 0) continue;
+					c = d->y[cur_ex];
+					hist[(slot[k]*nb + bin[j])*n_classes + c] += d->weight[c];
+				}
+			}
+			for (int i = first; i < last; i++) {
+				k = wanted[i].second;
+				h = hist.data() + (i - first)*nb*n_classes;
+				/* all the other examples in the node are zeros */
+				for (c = 0; c < n_classes; c++) {
+					nonzero = 0.0;
+					for (int b = 0; b < nb; b++) nonzero += h[b*n_classes + c];
+					h[d->zero_bin[f]*n_classes + c] += level[k].nd->cur_frequency[c] - nonzero;
+				}
+				level[k].s->split_bins(f, h, level[k].nd, d, level[k].cr);
+				slot[k] = -1;
+			}
+			continue;
+		}
 
-	/* invalid second */
-	for (int i = l; i < u; i++) 
-		this->valid[p[i].ex_id] -= 1;	
+		/* one pass over the column hands each entry to the node of its example */
+		for (int i = first; i < last; i++) n_entries[wanted[i].second] = 0;
+		for (int b = 0; b < d->get_n_blocks(f); b++) {
+			x = d->get_block(f, b, buf, n);
+			for (int j = 0; j < n; j++) {
+				k = node_of[x[j].ex_id];
+				if (k < 0 || slot[k] < 0) continue;
+				view[level[k].begin + n_entries[k]++] = x[j];
+			}
+		}
+		for (int i = first; i < last; i++) {
+			k = wanted[i].second;
+			level[k].s->split_feature(f, view + level[k].begin, n_entries[k], level[k].nd, d, level[k].cr);
+			slot[k] = -1;
+		}
+	}
 
-	/* 3. build first node */
-	build_rec(first, d, depth+1);	
+	if (buf != nullptr) {
+		delete[] buf;
+		buf = nullptr;
+	}
+	if (slot != nullptr) {
+		delete[] slot;
+		slot = nullptr;
+	}
+	if (n_entries != nullptr) {
+		delete[] n_entries;
+		n_entries = nullptr;
+	}
+}
 
-	/* valid second(add one more to be decrease in the next for loop */
-	for (int i = l; i < u; i++)
-		this->valid[p[i].ex_id] += 2;
-	/* all decrease 1 */
-	for (int i = 0; i < n_examples; i++) 
-		this->valid[i] -= 1;
+void decision_tree::partition_level(dataset*& d, std::vector<level_node_t>& level, const int* node_of, std::vector<int>& mid) {
+	std::vector<int> split_features;
+	ev_pair_t* buf = new ev_pair_t[COLUMN_BLOCK_SIZE];
+	const ev_pair_t* x;
+	bool zero_left;
+	int f, n, k, lo, hi, st, left_stamp, right_stamp;
 
-	/* 4. build second node */
-	build_rec(second, d, depth+1);
-	
-	/* restore valid */
-	for (int i = 0; i < n_examples; i++)
-		this->valid[i] += 1;
-	for (int i = l; i < u; i++)
-		this->valid[p[i].ex_id] -= 1;
+	for (k = 0; k < (int)level.size(); k++) {
+		if (level[k].s->fea_id != -1) split_features.push_back(level[k].s->fea_id);
+	}
+	std::sort(split_features.begin(), split_features.end());
+	split_features.erase(std::unique(split_features.begin(), split_features.end()), split_features.end());
+
+	/* examples with an entry of the split feature of their node are stamped with their side, the others follow the zeros */
+	left_stamp = ++node_stamp;
+	right_stamp = ++node_stamp;
+	for (int i = 0; i < (int)split_features.size(); i++) {
+		f = split_features[i];
+		for (int b = 0; b < d->get_n_blocks(f); b++) {
+			x = d->get_block(f, b, buf, n);
+			for (int j = 0; j < n; j++) {
+				k = node_of[x[j].ex_id];
+				if (k < 0 || level[k].s->fea_id != f) continue;
+				set_stamp(x[j].ex_id, level[k].nd->go_left(x[j].fea_value) ? left_stamp : right_stamp);
+			}
+		}
+	}
 
-	if (s != nullptr) {
-		delete s;
-		s = nullptr;
+	mid.assign(level.size(), 0);
+	for (k = 0; k < (int)level.size(); k++) {
+		if (level[k].s->fea_id == -1) continue;
+		zero_left = level[k].nd->zero_left();
+		lo = level[k].begin;
+		hi = level[k].end - 1;
+		while (lo <= hi) {
+			st = stamp_of(sample[lo]);
+			if (st == left_stamp || (st != right_stamp && zero_left)) lo++;
+			else std::swap(sample[lo], sample[hi--]);
+		}
+		mid[k] = lo;
 	}
-	if (cr != nullptr) {
-		delete cr;
-		cr = nullptr;
+
+	delete[] buf;
+}
+
+void decision_tree::make_leaf(node* nd) {
+	/* normalize */
+	float tot_frequency = 0.0;
+	for (int c = 0; c < nd->n_classes; c++) tot_frequency += nd->cur_frequency[c];
+	for (int c = 0; c < nd->n_classes; c++) nd->cur_frequency[c] /= tot_frequency;
+
+	/* attach this node to leaf node group */
+	nd->leaf_idx = add_leaf(nd);
+}
+
+void decision_tree::print_split(dataset*& d, splitter* s, int depth, int tot_ex) {
+	std::cout << "=================================" << std::endl;
+	std::cout << "Depth: " << depth << std::endl;
+	std::cout << "Total Examples: " << tot_ex << std::endl;
+	std::cout << "Split Feature: " << s->fea_id << " "
+			  << "Threshold: " << s->threshold << std::endl;
+	std::cout << "Valid Example: " << std::endl;
+	for (int i = s->node_begin; i < s->node_end; i++) 
+		std::cout << "#" << sample[i] << ":" << d->y[sample[i]] << " ";
+	std::cout << std::endl;
+	std::cout << "Nonzero Values: " << std::endl;	
+	ev_pair_t* buf = new ev_pair_t[COLUMN_BLOCK_SIZE];
+	const ev_pair_t* col;
+	int n;
+	for (int b = 0; b < d->get_n_blocks(s->fea_id); b++) {
+		col = d->get_block(s->fea_id, b, buf, n);
+		for (int i = 0; i < n; i++) {
+			if (stamp_of(col[i].ex_id) == s->node_stamp)
+				std::cout << col[i].ex_id << ":" << col[i].fea_value << " ";
+		}
 	}
+	delete[] buf;
+	std::cout << std::endl << std::endl;
 }
 
+void decision_tree::enter_node(splitter* s, int begin, int end) {
+	s->node_begin = begin;
+	s->node_end = end;
+	s->node_stamp = ++node_stamp;
+	for (int i = begin; i < end; i++) set_stamp(sample[i], s->node_stamp);
+}
+
+int decision_tree::partition(dataset*& d, node* nd, splitter* s) {
+	ev_pair_t* buf;
+	const ev_pair_t* col;
+	feature_t v;
+	int f = nd->feature_id, n, j, k, l, u, side_stamp, lo = s->node_begin, hi = s->node_end - 1;
+	bool zero_left = nd->zero_left();
+	double lookup_cost = (s->node_end - s->node_begin)*(log2(d->get_avg_row_size() + 2) + 1);
+
+	/* entries [0, k) of the column are not larger than `threshold`, the zeros are on the other side of [l, u), 
+	 * the categories of a categorical split can be anywhere in the column */
+	if (nd->is_cate) {
+		l = 0;
+		u = d->size[f];
+	} else {
+		k = d->upper_bound(f, nd->threshold);
+		l = zero_left ? k : 0;
+		u = zero_left ? d->size[f] : k;
+	}
+
+	if (d->is_dense[f] || (d->has_rows() && lookup_cost < u - l)) {
+		while (lo <= hi) {
+			if (d->lookup(sample[lo], f, v) ? nd->go_left(v) : zero_left) lo++;
+			else std::swap(sample[lo], sample[hi--]);
+		}
+		return lo;
+	}
+
+	/* stamp the examples of the node in entries [l, u) which do not go with the zeros, only the blocks overlapping [l, u) are decoded */
+	side_stamp = ++node_stamp;
+	buf = s->column_buffer();
+	for (int b = l / COLUMN_BLOCK_SIZE; b*COLUMN_BLOCK_SIZE < u; b++) {
+		col = d->get_block(f, b, buf, n);
+		j = std::max(l - b*COLUMN_BLOCK_SIZE, 0);
+		n = std::min(n, u - b*COLUMN_BLOCK_SIZE);
+		for (; j < n; j++) {
+			if (stamp_of(col[j].ex_id) == s->node_stamp && (!nd->is_cate || nd->go_left(col[j].fea_value) != zero_left)) 
+				set_stamp(col[j].ex_id, side_stamp);
+		}
+	}
+	while (lo <= hi) {
+		if ((stamp_of(sample[lo]) == side_stamp) != zero_left) lo++;
+		else std::swap(sample[lo], sample[hi--]);
+	}
+	return lo;
+}
 
 void decision_tree::debug(dataset*& d) {
 	this->verbose = 1;
@@ -731,8 +1160,16 @@ void decision_tree::debug(dataset*& d) {
 }
 
 splitter::splitter(int n_classes) {
+	node_begin = node_end = node_stamp = 0;
 	left_frequency = new float[n_classes]();
 	right_frequency = new float[n_classes]();
+	tmp_left = new float[n_classes];
+	tmp_right = new float[n_classes];
+	tmp_zero = new float[n_classes];
+	tmp_nonzero = new float[n_classes];
+	block_buf = view_buf = nullptr;
+	candidate = nullptr;
+	block_size = view_size = candidate_size = 0;
 	this->gain = 0.0;
 	this->fea_id = -1;
 	this->threshold = 0.0;
@@ -748,34 +1185,55 @@ splitter::~splitter() {
 		delete[] right_frequency;
 		right_frequency = nullptr;
 	}
+	delete[] tmp_left;
+	delete[] tmp_right;
+	delete[] tmp_zero;
+	delete[] tmp_nonzero;
+	if (block_buf != nullptr) delete[] block_buf;
+	if (view_buf != nullptr) delete[] view_buf;
+	if (candidate != nullptr) delete[] candidate;
 }
 
-best_splitter::best_splitter(int n_classes) : splitter(n_classes) {
-
+ev_pair_t* splitter::reserve(ev_pair_t*& buf, int& size, int n) {
+	if (n > size) {
+		if (buf != nullptr) delete[] buf;
+		buf = new ev_pair_t[n];
+		size = n;
+	}
+	return buf;
 }
 
-best_splitter::~best_splitter() {
-
+int* splitter::reserve(int*& buf, int& size, int n) {
+	if (n > size) {
+		if (buf != nullptr) delete[] buf;
+		buf = new int[n];
+		size = n;
+	}
+	return buf;
 }
 
-void best_splitter::split(tree* t, node*& root, dataset*& d, criterion*& cr) {
-	ev_pair_t* x;
-	int f, j, fst_valid, cur_ex, prev, prev_ex;
-	float *zero_frequency, *nonzero_frequency; /* these two are for current node */
-	float *left_frequency, threshold;
-	int n_classes = d->get_n_classes(), max_feature = t->get_max_feature(), n_features = t->get_n_features(); 
+ev_pair_t* splitter::column_buffer() {
+	return reserve(block_buf, block_size, COLUMN_BLOCK_SIZE);
+}
 
-	/* the key idea of this sparse split is to determine where to put zero examples */
-	zero_frequency = new float[n_classes];
-	nonzero_frequency = new float[n_classes];
+ev_pair_t* splitter::view_buffer() {
+	/* the root comes first, so the buffer has its final size after the first node */
+	return reserve(view_buf, view_size, node_end - node_begin);
+}
 
-	/* did not set `right_frequency` because `current node` minus `left_frequency` is `right_frequency` */
-	left_frequency = new float[n_classes];
+void splitter::reset() {
+	this->gain = 0.0;
+	this->fea_id = -1;
+	this->threshold = 0.0;
+	this->cate_set.clear();
+}
 
-	/* reset `criterion` class */
-	cr->set_current(root->cur_frequency, n_classes);
+int* splitter::sample_features(tree* t, dataset*& d, int& n_candidates) {
+	int max_feature = t->get_max_feature(), n_features = t->get_n_features(); 
+	int* candidate_feature, c_idx, tmp;
 
-	int* candidate_feature = new int[n_features], c_idx, tmp;
+	n_candidates = max_feature;
+	candidate_feature = reserve(candidate, candidate_size, n_features);
 	for (int i = 0; i < n_features; i++) candidate_feature[i] = i;
 	for (int i = 0; i < max_feature; i++) {
 		//c_idx = m_random::getInstance().next_int(i, n_features);
@@ -784,118 +1242,415 @@ void best_splitter::split(tree* t, node*& root, dataset*& d, criterion*& cr) {
 		candidate_feature[i] = candidate_feature[c_idx]; 
 		candidate_feature[c_idx] = tmp;
 	}
+	return candidate_feature;
+}
 
-	for (int i = 0; i < max_feature; i++) {
-		f = candidate_feature[i];		/* choose a feature to test */	
-		x = d->x[f];
-		if (!d->is_cate[f]) { /* if the feature is continuous */
-			/* find the first valid example index */
-			fst_valid = -1; /* example index */
-			for (j = 0; j < d->size[f]; j++) {
-				cur_ex = x[j].ex_id;
-				if (t->valid[cur_ex] > 0) { /* find an valid example */
-					fst_valid = cur_ex;
-					break;
-				}
+bool splitter::prefer_scan(dataset*& d, int f) {
+	double m = node_end - node_begin, n_examples = d->get_n_examples(), k;
+
+	/* gathering costs a lookup per example of the node and a sort of what is found */
+	if (d->is_dense[f]) return n_examples <= m*(log2(m + 1) + 1);
+	if (!d->has_rows()) return true;
+	k = d->size[f]*m / n_examples;
+	return d->size[f] <= m*(log2(d->get_avg_row_size() + 2) + 1) + k*log2(k + 1);
+}
+
+int splitter::node_column(tree* t, dataset*& d, int f, ev_pair_t* view, bool sorted) {
+	const ev_pair_t* x;
+	ev_pair_t* buf;
+	const int* order;
+	feature_t v;
+	int n = 0, len, cur_ex;
+
+	if (prefer_scan(d, f)) {
+		/* the column is sorted, so are the entries of the node */
+		if (d->is_dense[f]) {
+			order = d->order[f];
+			for (int j = 0; j < d->get_n_examples(); j++) {
+				cur_ex = order[j];
+				if (t->stamp_of(cur_ex) == node_stamp) view[n++].set(cur_ex, d->dense_value[f][cur_ex]);
 			}
-			/* all the non-zero examples of this feature are not valid */
-			if (fst_valid < 0) continue;
+			return n;
+		}
+		buf = column_buffer();
+		for (int b = 0; b < d->get_n_blocks(f); b++) {
+			x = d->get_block(f, b, buf, len);
+			for (int j = 0; j < len; j++) {
+				if (t->stamp_of(x[j].ex_id) == node_stamp) view[n++] = x[j];
+			}
+		}
+		return n;
+	}
 
-			/* here j mean the index of first valid example in `x`*/
-			prev = j;
+	for (int i = node_begin; i < node_end; i++) {
+		cur_ex = t->sample[i];
+		if (d->lookup(cur_ex, f, v)) view[n++].set(cur_ex, v);
+	}
+	if (sorted) {
+		std::sort(view, view + n, [](const ev_pair_t& a, const ev_pair_t& b) {
+			return a.fea_value < b.fea_value || (a.fea_value == b.fea_value && a.ex_id < b.ex_id);
+		});
+	}
+	return n;
+}
 
-			/* Here we get two vector (`n_classes` dimensional), `zero_frequency` and `nonzero_frequency` */
-			/* 1.get the frequency of nonzero examples */
-			/* reset `nonzero_frequency` */
-			memset(nonzero_frequency, 0, sizeof(float)*n_classes);
-			for (j = prev; j < d->size[f]; j++) {
-				cur_ex = x[j].ex_id;
-				/* find all the valid example */
-				if (t->valid[cur_ex] <= 0) continue;
+best_splitter::best_splitter(int n_classes) : splitter(n_classes) {
+	this->kernel = (n_classes >= 2 && n_classes <= 4) ? n_classes : 0;
+}
 
-				nonzero_frequency[d->y[cur_ex]] += d->weight[d->y[cur_ex]];
-			}
+best_splitter::~best_splitter() {
+	for (int i = 0; i < (int)part.size(); i++) {
+		delete part[i];
+		delete part_cr[i];
+	}
+}
 
-			/* 2.except nonzero is zero */
-			for (int c = 0; c < n_classes; c++) 
-				zero_frequency[c] = root->cur_frequency[c] - nonzero_frequency[c]; 
-
-			memset(left_frequency, 0, sizeof(float)*n_classes);
-			/* if first valid example's feature value is positive, then zero examples must be in the left child node */		
-			if (x[prev].fea_value > 0.0) {
-				for (int c = 0; c < n_classes; c++) 
-					left_frequency[c] += zero_frequency[c];
-				
-				/* as all nonzero feature value is positive, so the first split threshold should between 0 and x[prev].fea_value */
-				threshold = 0.5*(0 + x[prev].fea_value);
-				update(f, threshold, left_frequency, root, cr);
-			}
+void best_splitter::split(tree* t, node*& root, dataset*& d, criterion*& cr) {
+	int n_candidates, c_begin, c_end;
+	int n_classes = d->get_n_classes(); 
+	task_scheduler* sched = t->get_scheduler();
+	std::atomic<int> pending(0);
 
-			/* if first example's feature value is negative, then we search until x[prev].fea_value<0 && x[cur].fea_value>0 and put zero examples between them */
-			/* `prev` means index in vector `x` */
-			/* `prev_ex` means x[prev].ex_id */ 
-			prev_ex = fst_valid;
-			for (int cur = prev+1; cur < d->size[f]; cur++) {
-				cur_ex = x[cur].ex_id;
-				/* find all valid examples */
-				if (t->valid[cur_ex] <= 0) continue;
-
-				/* add current example to left */
-				left_frequency[d->y[prev_ex]] += d->weight[d->y[prev_ex]];
-
-				/* x[prev].fea_value        0        x[cur].fea_value */
-				/*                     ^        ^                     */
-				/* two thresholds to split denoted by ^ above */
-				if (x[prev].fea_value < 0 && x[cur].fea_value > 0) {
-					/* threshold 1 (x[prev].fea_value*/
-					threshold = 0.5*(x[prev].fea_value + 0.0);	
-					update(f, threshold, left_frequency, root, cr); 
-
-					/* threshold 2 */
-					/* add zero examples to left */
-					for (int c = 0; c < n_classes; c++) 
-						left_frequency[c] += zero_frequency[c];
-					threshold = 0.5*(0.0 + x[cur].fea_value);
-					update(f, threshold, left_frequency, root, cr);
-				}
+	/* reset `criterion` class */
+	cr->set_current(root->cur_frequency, n_classes);
 
-				/* test a split between x[prev].fea_value and x[cur].fea_value */
-				if (x[prev].fea_value != x[cur].fea_value /* feature value of previous and current are different */
-						&& d->y[prev_ex] != d->y[cur_ex] /* class label of previous and current are different */) {
-					threshold = 0.5*(x[prev].fea_value + x[cur].fea_value);
-					update(f, threshold, left_frequency, root, cr);
-				}
+	int* candidate_feature = sample_features(t, d, n_candidates);
 
-				/* assign current info to prev */
-				prev = cur;
-				prev_ex = cur_ex;
-			}
+	/* a small node is not worth the tasks */
+	parallel_unit pu = init_block(n_candidates, 
+		sched != nullptr && node_end - node_begin >= PARALLEL_SPLIT_MIN_EXAMPLES ? t->get_n_threads() : 1);
+
+	/* this thread takes the first block, the tasks keep their best split in `part` (kept for the next large node), 
+	 * which must not grow once the tasks are spawned */
+	while ((int)part.size() < pu.num_threads - 1) {
+		part.push_back(new best_splitter(n_classes));
+		/* `criterion` keeps temporaries, each thread needs its own */
+		part_cr.push_back(new gini());
+	}
+	c_begin = pu.block_size;
+	for (int i = 0; i < pu.num_threads - 1; i++) {
+		c_end = i == pu.num_threads - 2 ? n_candidates : c_begin + pu.block_size;
+		part[i]->reset();
+		part[i]->node_begin = node_begin;
+		part[i]->node_end = node_end;
+		part[i]->node_stamp = node_stamp;
+		part_cr[i]->set_current(root->cur_frequency, n_classes);
+		sched->spawn([&, i, c_begin, c_end]() {
+			part[i]->split_candidates(t, root, d, part_cr[i], candidate_feature + c_begin, c_end - c_begin);
+		}, pending);
+		c_begin = c_end;
+	}
+	split_candidates(t, root, d, cr, candidate_feature, pu.block_size);
+
+	if (pu.num_threads > 1) sched->wait(pending);
+	/* in candidate order, so a tie goes to the earlier candidate */
+	for (int i = 0; i < pu.num_threads - 1; i++) merge(part[i]);
+}
+
+void best_splitter::split_candidates(tree* t, node*& root, dataset*& d, criterion*& cr, const int* candidate_feature, int n_candidates) {
+	ev_pair_t* view;
+	int f, n;
+
+	/* entries of a candidate column in this node, there are no more than the examples of the node */
+	view = view_buffer();
+
+	for (int i = 0; i < n_candidates; i++) {
+		f = candidate_feature[i];		/* choose a feature to test */	
+
+		/* categories are counted, so they need not be sorted */
+		n = node_column(t, d, f, view, !d->is_cate[f]);
+		split_feature(f, view, n, root, d, cr);
+	}
+}
+
+void best_splitter::merge(const best_splitter* s) {
+	if (s->gain <= this->gain) return;
+	this->gain = s->gain;
+	this->fea_id = s->fea_id;
+	this->threshold = s->threshold;
+	memcpy(this->left_frequency, s->left_frequency, sizeof(float)*n_classes);
+	memcpy(this->right_frequency, s->right_frequency, sizeof(float)*n_classes);
+	this->cate_set = s->cate_set;
+}
+
+template <int K>
+void best_splitter::update_k(int t_fea_id, float threshold, const float* left, node*& nd, gini* cr) {
+	const int m = K > 0 ? K : n_classes;
+	float* right = tmp_right;
+	float t_gain;
+
+	for (int c = 0; c < m; c++) 
+		right[c] = nd->cur_frequency[c] - left[c];
+
+	t_gain = cr->gain_k<K>(left, right, m);
+
+	if (t_gain > this->gain) {
+		this->gain = t_gain;
+		this->fea_id = t_fea_id;
+		this->threshold = threshold;
+		memcpy(this->left_frequency, left, sizeof(float)*m);
+		memcpy(this->right_frequency, right, sizeof(float)*m);
+	}
+}
+
+template <int K>
+void best_splitter::split_sparse(int f, const ev_pair_t* view, int n, node*& root, dataset*& d, gini* cr) {
+	const int m = K > 0 ? K : n_classes;
+	int j, cur_ex, prev_ex;
+	float *zero_frequency, *nonzero_frequency; /* these two are for current node */
+	float *left_frequency, threshold, prev_value, cur_value;
+
+	/* all the non-zero examples of this feature are not in the node */
+	if (n == 0) return;
+
+	/* did not set `right_frequency` because `current node` minus `left_frequency` is `right_frequency` */
+	left_frequency = tmp_left;
+	/* the key idea of this sparse split is to determine where to put zero examples */
+	zero_frequency = tmp_zero;
+	nonzero_frequency = tmp_nonzero;
+
+	/* Here we get two vector (`n_classes` dimensional), `zero_frequency` and `nonzero_frequency` */
+	/* 1.get the frequency of nonzero examples */
+	memset(nonzero_frequency, 0, sizeof(float)*m);
+	for (j = 0; j < n; j++) 
+		nonzero_frequency[d->y[view[j].ex_id]] += d->weight[d->y[view[j].ex_id]];
+
+	/* 2.except nonzero is zero */
+	for (int c = 0; c < m; c++) 
+		zero_frequency[c] = root->cur_frequency[c] - nonzero_frequency[c]; 
+
+	memset(left_frequency, 0, sizeof(float)*m);
+	prev_ex = view[0].ex_id;
+	prev_value = view[0].fea_value;
+	/* if first example's feature value is positive, then zero examples must be in the left child node */		
+	if (prev_value > 0.0) {
+		for (int c = 0; c < m; c++) 
+			left_frequency[c] += zero_frequency[c];
+		
+		/* as all nonzero feature value is positive, so the first split threshold should between 0 and prev_value */
+		threshold = 0.5*(0 + prev_value);
+		update_k<K>(f, threshold, left_frequency, root, cr);
+	}
 
-		} else { /* if the feature categorical */
-			
+	/* if first example's feature value is negative, then we search until prev_value<0 && cur_value>0 and put zero examples between them */
+	/* `prev_ex` and `prev_value` are the previous entry */ 
+	for (j = 1; j < n; j++) {
+		cur_ex = view[j].ex_id;
+		cur_value = view[j].fea_value;
+
+		/* add current example to left */
+		left_frequency[d->y[prev_ex]] += d->weight[d->y[prev_ex]];
+
+		/* prev_value        0        cur_value */
+		/*              ^        ^              */
+		/* two thresholds to split denoted by ^ above */
+		if (prev_value < 0 && cur_value > 0) {
+			/* threshold 1 (prev_value*/
+			threshold = 0.5*(prev_value + 0.0);	
+			update_k<K>(f, threshold, left_frequency, root, cr); 
+
+			/* threshold 2 */
+			/* add zero examples to left */
+			for (int c = 0; c < m; c++) 
+				left_frequency[c] += zero_frequency[c];
+			threshold = 0.5*(0.0 + cur_value);
+			update_k<K>(f, threshold, left_frequency, root, cr);
 		}
+
+		/* test a split between prev_value and cur_value */
+		if (prev_value != cur_value /* feature value of previous and current are different */
+				&& d->y[prev_ex] != d->y[cur_ex] /* class label of previous and current are different */) {
+			threshold = 0.5*(prev_value + cur_value);
+			update_k<K>(f, threshold, left_frequency, root, cr);
+		}
+
+		/* assign current info to prev */
+		prev_value = cur_value;
+		prev_ex = cur_ex;
 	}
+}
 
-	if (zero_frequency != nullptr) {
-		delete[] zero_frequency;
-		zero_frequency = nullptr;
+template <int K>
+void best_splitter::split_dense(int f, const ev_pair_t* view, int n, node*& root, dataset*& d, gini* cr) {
+	const int m = K > 0 ? K : n_classes;
+	float* left_frequency = tmp_left;
+	int cur_ex, prev_ex;
+	float threshold;
+
+	memset(left_frequency, 0, sizeof(float)*m);
+	for (int j = 1; j < n; j++) {
+		prev_ex = view[j-1].ex_id;
+		cur_ex = view[j].ex_id;
+
+		/* add previous example to left */
+		left_frequency[d->y[prev_ex]] += d->weight[d->y[prev_ex]];
+
+		/* test a split between the previous and the current value */
+		if (view[j-1].fea_value != view[j].fea_value && d->y[prev_ex] != d->y[cur_ex]) {
+			threshold = 0.5*(view[j-1].fea_value + view[j].fea_value);
+			update_k<K>(f, threshold, left_frequency, root, cr);
+		}
 	}
-	if (nonzero_frequency != nullptr) {
-		delete[] nonzero_frequency;
-		nonzero_frequency = nullptr;
+}
+
+template <int K>
+void best_splitter::split_binned(int f, const float* hist, node*& root, dataset*& d, gini* cr) {
+	const int m = K > 0 ? K : n_classes;
+	int nb = d->n_bins[f];
+	float *left_frequency, bin_tot, left_tot, right_tot;
+
+	/* threshold between bin b and bin b+1 is cut[f][b] */
+	left_frequency = tmp_left;
+	memset(left_frequency, 0, sizeof(float)*m);
+	for (int b = 0; b < nb-1; b++) {
+		bin_tot = left_tot = right_tot = 0.0;
+		for (int c = 0; c < m; c++) {
+			bin_tot += hist[b*m + c];
+			left_frequency[c] += hist[b*m + c];
+			left_tot += left_frequency[c];
+			right_tot += root->cur_frequency[c] - left_frequency[c];
+		}
+		/* an empty bin gives the same split as the previous threshold */
+		if (bin_tot > 1e-6 && left_tot > 1e-6 && right_tot > 1e-6)
+			update_k<K>(f, d->cut[f][b], left_frequency, root, cr);
 	}
-	if (left_frequency != nullptr) {
-		delete[] left_frequency;
-		left_frequency = nullptr;
+}
+
+void best_splitter::split_feature(int f, const ev_pair_t* view, int n, node*& root, dataset*& d, criterion*& cr) {
+	/* the specialized scans are written for gini, which is the criterion of every splitter */
+	gini* g = static_cast<gini*>(cr);
+
+	if (d->is_cate[f]) {
+		split_categories(f, view, n, root, d, cr);
+		return;
+	}
+
+	/* the scan of the number of classes chosen by the constructor, every threshold is tested without a virtual call */
+	switch (kernel) {
+		case 2:
+			if (d->is_dense[f]) split_dense<2>(f, view, n, root, d, g);
+			else split_sparse<2>(f, view, n, root, d, g);
+			break;
+		case 3:
+			if (d->is_dense[f]) split_dense<3>(f, view, n, root, d, g);
+			else split_sparse<3>(f, view, n, root, d, g);
+			break;
+		case 4:
+			if (d->is_dense[f]) split_dense<4>(f, view, n, root, d, g);
+			else split_sparse<4>(f, view, n, root, d, g);
+			break;
+		default:
+			if (d->is_dense[f]) split_dense<0>(f, view, n, root, d, g);
+			else split_sparse<0>(f, view, n, root, d, g);
+			break;
+	}
+}
+
+void best_splitter::split_categories(int f, const ev_pair_t* view, int n, node*& root, dataset*& d, criterion*& cr) {
+	int *cate, *slot = nullptr, *order, n_cates, max_cate = 0, k, c, key, best_key = -1, best_len = 0;
+	float *table, *tot, *left_frequency, prev_gain;
+
+	/* 1. frequency table of the categories in the node, the examples without an entry are category 0. 
+	 * Few categories are counted through a slot per category, many are grouped by sorting the entries */
+	for (int j = 0; j < n; j++) max_cate = std::max(max_cate, (int)view[j].fea_value);
+	if (max_cate > 4*n + 256) {
+		cate_entry.assign(view, view + n);
+		std::sort(cate_entry.begin(), cate_entry.end(), [](const ev_pair_t& a, const ev_pair_t& b) {
+			return a.fea_value < b.fea_value;
+		});
+		view = cate_entry.data();
+	} else {
+		cate_slot.assign(max_cate + 1, -1);
+		slot = cate_slot.data();
+		slot[0] = 0;
+	}
+	cate_id.resize(n + 1);
+	cate_table.assign((n + 1)*n_classes, 0.0);
+	cate = cate_id.data();
+	table = cate_table.data();
+	cate[0] = 0;
+	/* category 0 is counted in examples rather than weights, a residue of float subtraction is not a category */
+	for (c = 0; c < n_classes; c++) table[c] = (int)(root->cur_frequency[c] / d->weight[c] + 0.5);
+	n_cates = 1;
+	for (int j = 0; j < n; j++) {
+		k = (int)view[j].fea_value;
+		if (k == 0) continue;
+		if (slot != nullptr) {
+			if (slot[k] < 0) {
+				slot[k] = n_cates;
+				cate[n_cates++] = k;
+			}
+			key = slot[k];
+		} else {
+			if (k != cate[n_cates-1]) cate[n_cates++] = k;
+			key = n_cates-1;
+		}
+		c = d->y[view[j].ex_id];
+		table[key*n_classes + c] += d->weight[c];
+		table[c] -= 1;
+	}
+	for (c = 0; c < n_classes; c++) table[c] *= d->weight[c];
+	/* drop the empty ones (category 0 may have no example) */
+	cate_tot.assign(n_cates, 0.0);
+	tot = cate_tot.data();
+	k = 0;
+	for (int i = 0; i < n_cates; i++) {
+		for (c = 0; c < n_classes; c++) tot[k] += table[i*n_classes + c];
+		if (tot[k] <= 1e-6) {
+			tot[k] = 0.0;
+			continue;
+		}
+		cate[k] = cate[i];
+		memmove(table + k*n_classes, table + i*n_classes, sizeof(float)*n_classes);
+		k++;
+	}
+	n_cates = k;
+
+	/* 2. order the categories by the rate of a class, the left child takes a prefix of the order. 
+	 * For two classes one order is enough, otherwise each class is tried */
+	cate_order.resize(n_cates);
+	order = cate_order.data();
+	left_frequency = tmp_left;
+	for (key = n_classes == 2 ? 1 : 0; n_cates > 1 && key < n_classes; key++) {
+		for (int i = 0; i < n_cates; i++) order[i] = i;
+		std::sort(order, order + n_cates, [&](int a, int b) {
+			float ra = table[a*n_classes + key] / tot[a], rb = table[b*n_classes + key] / tot[b];
+			return ra < rb || (ra == rb && a < b);
+		});
+		memset(left_frequency, 0, sizeof(float)*n_classes);
+		for (int i = 1; i < n_cates; i++) {
+			for (c = 0; c < n_classes; c++) left_frequency[c] += table[order[i-1]*n_classes + c];
+			prev_gain = this->gain;
+			update(f, 0.0, left_frequency, root, cr);
+			if (this->gain > prev_gain) {
+				best_key = key;
+				best_len = i;
+			}
+		}
+		if (best_key == key) {
+			/* 3. keep the left categories as a bit set */
+			k = 0;
+			for (int i = 0; i < best_len; i++) k = std::max(k, cate[order[i]]);
+			cate_set.assign(k / 32 + 1, 0);
+			for (int i = 0; i < best_len; i++) 
+				cate_set[cate[order[i]] >> 5] |= 1u << (cate[order[i]] & 31);
+		}
 	}
-	if (candidate_feature != nullptr) {
-		delete candidate_feature;
-		candidate_feature = nullptr;
+}
+
+void best_splitter::split_bins(int f, const float* hist, node*& root, dataset*& d, criterion*& cr) {
+	gini* g = static_cast<gini*>(cr);
+
+	switch (kernel) {
+		case 2: split_binned<2>(f, hist, root, d, g); break;
+		case 3: split_binned<3>(f, hist, root, d, g); break;
+		case 4: split_binned<4>(f, hist, root, d, g); break;
+		default: split_binned<0>(f, hist, root, d, g); break;
 	}
 }
 
 void best_splitter::update(int t_fea_id, float threshold, float*& left, node*& nd, criterion*& cr) {
-	float* right = new float[n_classes]();
+	float* right = tmp_right;
 	for (int c = 0; c < n_classes; c++) 
 		right[c] = nd->cur_frequency[c] - left[c];
 
@@ -910,10 +1665,184 @@ void best_splitter::update(int t_fea_id, float threshold, float*& left, node*& n
 		memcpy(this->left_frequency, left, sizeof(float)*n_classes);
 		memcpy(this->right_frequency, right, sizeof(float)*n_classes);
 	}
+}
+
+hist_splitter::hist_splitter(int n_classes, hist_cache_t* cur, const hist_cache_t* parent, const hist_cache_t* sibling) : best_splitter(n_classes) {
+	set_histograms(cur, parent, sibling);
+}
+
+void hist_splitter::set_histograms(hist_cache_t* cur, const hist_cache_t* parent, const hist_cache_t* sibling) {
+	this->cur = cur;
+	this->parent = parent;
+	this->sibling = sibling;
+}
+
+hist_splitter::~hist_splitter() {
+
+}
+
+void hist_splitter::node_histogram(tree* t, node*& root, dataset*& d, int f, std::vector<float>& hist) {
+	const ev_pair_t* x;
+	ev_pair_t* buf;
+	ev_pair_t* view;
+	unsigned char* bin;
+	int nb = d->n_bins[f], c, n, cur_ex;
+	int n_classes = d->get_n_classes(); 
+	float* nonzero_frequency = tmp_nonzero;
+	hist_cache_t::const_iterator p_it, s_it;
+
+	if (parent != nullptr && sibling != nullptr 
+			&& (p_it = parent->find(f)) != parent->end() 
+			&& (s_it = sibling->find(f)) != sibling->end()) {
+		/* examples of this node are the parent's minus the sibling's, so are the histograms */
+		hist.resize(nb*n_classes);
+		for (int k = 0; k < nb*n_classes; k++) hist[k] = p_it->second[k] - s_it->second[k];
+		return;
+	}
+
+	hist.assign(nb*n_classes, 0.0);
+	memset(nonzero_frequency, 0, sizeof(float)*n_classes);
+	if (prefer_scan(d, f)) {
+		/* one pass over the column to get the histogram of non-zero examples */
+		buf = column_buffer();
+		for (int b = 0; b < d->get_n_blocks(f); b++) {
+			x = d->get_block(f, b, buf, n);
+			bin = d->bin[f] + b*COLUMN_BLOCK_SIZE;
+			for (int j = 0; j < n; j++) {
+				cur_ex = x[j].ex_id;
+				if (t->stamp_of(cur_ex) != node_stamp) continue;
+				c = d->y[cur_ex];
+				hist[bin[j]*n_classes + c] += d->weight[c];
+				nonzero_frequency[c] += d->weight[c];
+			}
+		}
+	} else {
+		/* a small node looks its examples up, the bin of a value is the number of cut points less than it */
+		view = view_buffer();
+		n = node_column(t, d, f, view, false);
+		for (int j = 0; j < n; j++) {
+			c = d->y[view[j].ex_id];
+			hist[(std::lower_bound(d->cut[f], d->cut[f] + nb-1, view[j].fea_value) - d->cut[f])*n_classes + c] += d->weight[c];
+			nonzero_frequency[c] += d->weight[c];
+		}
+	}
+	/* all the other examples in this node are zeros */
+	for (c = 0; c < n_classes; c++) 
+		hist[d->zero_bin[f]*n_classes + c] += root->cur_frequency[c] - nonzero_frequency[c];
+}
+
+void hist_splitter::split(tree* t, node*& root, dataset*& d, criterion*& cr) {
+	ev_pair_t* view = view_buffer();
+	int f, n, n_candidates;
+	int n_classes = d->get_n_classes(); 
+	double p;
+	bool keep;
+	hist_cache_t next; /* histograms of this node */
+
+	/* reset `criterion` class */
+	cr->set_current(root->cur_frequency, n_classes);
+
+	int* candidate_feature = sample_features(t, d, n_candidates);
+
+	/* the second child derives the histogram of a candidate only if its parent and sibling have sampled it too, 
+	 * i.e. a fraction p^2 of its candidates if every node samples a fraction p of the valid features. Building the 
+	 * other features as well costs more scans than the derived ones save unless nearly all of them are sampled, 
+	 * so the histograms are only kept when a fair part of them can be reused (not under `sqrt` or `log`) */
+	p = (double)n_candidates / std::max(d->n_valid, 1);
+	keep = p*p >= HIST_KEEP_MIN_REUSE;
+
+	for (int i = 0; i < n_candidates; i++) {
+		f = candidate_feature[i];		/* choose a feature to test */	
+		if (d->is_cate[f]) {
+			/* categories are not binned, their frequency tables are built from the entries */
+			n = node_column(t, d, f, view, false);
+			split_feature(f, view, n, root, d, cr);
+			continue;
+		}
+		std::vector<float>& hist = keep ? next[f] : hist_buf;
+		node_histogram(t, root, d, f, hist);
+		split_bins(f, hist.data(), root, d, cr);
+	}
+
+	/* `cur` may be the same as `sibling`, so only overwrite it at the end */
+	*cur = std::move(next);
+}
+
+random_splitter::random_splitter(int n_classes) : best_splitter(n_classes) {
+
+}
+
+random_splitter::~random_splitter() {
+
+}
+
+void random_splitter::split(tree* t, node*& root, dataset*& d, criterion*& cr) {
+	ev_pair_t* view;
+	int f, n, n_candidates;
+	int n_classes = d->get_n_classes(); 
+
+	/* entries of a candidate column in this node, there are no more than the examples of the node */
+	view = view_buffer();
+
+	/* reset `criterion` class */
+	cr->set_current(root->cur_frequency, n_classes);
+
+	int* candidate_feature = sample_features(t, d, n_candidates);
+
+	for (int i = 0; i < n_candidates; i++) {
+		f = candidate_feature[i];		/* choose a feature to test */	
+
+		/* only counted, so the entries are left unsorted */
+		n = node_column(t, d, f, view, false);
+		split_feature(f, view, n, root, d, cr);
+	}
+}
+
+void random_splitter::split_feature(int f, const ev_pair_t* view, int n, node*& root, dataset*& d, criterion*& cr) {
+	float *zero_frequency, *left_frequency, min_value, max_value, threshold;
+	bool has_zero = false;
 
-	if (right != nullptr) {
-		delete[] right;
-		right = nullptr;
+	/* the best partition of the categories is cheap to find, there is no need to draw one */
+	if (d->is_cate[f]) {
+		split_categories(f, view, n, root, d, cr);
+		return;
+	}
+	/* all the non-zero examples of this feature are not in the node */
+	if (n == 0) return;
+
+	zero_frequency = tmp_zero;
+	left_frequency = tmp_left;
+	memset(left_frequency, 0, sizeof(float)*n_classes);
+
+	/* 1. range of the values, the examples without an entry are zeros */
+	min_value = max_value = view[0].fea_value;
+	for (int c = 0; c < n_classes; c++) zero_frequency[c] = root->cur_frequency[c];
+	for (int j = 0; j < n; j++) {
+		min_value = std::min(min_value, view[j].fea_value);
+		max_value = std::max(max_value, view[j].fea_value);
+		zero_frequency[d->y[view[j].ex_id]] -= d->weight[d->y[view[j].ex_id]];
+	}
+	if (!d->is_dense[f]) {
+		for (int c = 0; c < n_classes; c++) 
+			if (zero_frequency[c] > 1e-6) has_zero = true;
+	}
+	if (has_zero) {
+		min_value = std::min(min_value, (feature_t)0.0);
+		max_value = std::max(max_value, (feature_t)0.0);
+	}
+
+	/* 2. one random threshold, the examples not larger than it go left (so do the zeros if it is not negative) */
+	if (min_value < max_value) {
+		threshold = min_value + (max_value - min_value)*((double)m_random::getInstance().next_int(0, RANDOM_SPLIT_RESOLUTION) / RANDOM_SPLIT_RESOLUTION);
+		for (int j = 0; j < n; j++) {
+			if (view[j].fea_value <= threshold) 
+				left_frequency[d->y[view[j].ex_id]] += d->weight[d->y[view[j].ex_id]];
+		}
+		if (has_zero && threshold >= 0) {
+			for (int c = 0; c < n_classes; c++) 
+				left_frequency[c] += zero_frequency[c];
+		}
+		update(f, threshold, left_frequency, root, cr);
 	}
 }
 
@@ -938,11 +1867,6 @@ void criterion::set_current(float*& frequency, int n_classes) {
 float criterion::gain(float*& left_frequency, float*& right_frequency, int n_classes) {
 	float left_tot, right_tot;
 	float left_measure, right_measure;
-	/* need to set current node before call gain function */
-	if (!is_init) {
-		std::cerr << "Please set current measure before call gain" << std::endl;
-		exit(EXIT_FAILURE);
-	}
 	/* calculate left child node measure */
 	left_measure = measure(left_frequency, n_classes);
 	left_tot = this->tot_frequency;
@@ -950,10 +1874,11 @@ float criterion::gain(float*& left_frequency, float*& right_frequency, int n_cla
 	right_measure = measure(right_frequency, n_classes);
 	right_tot = this->tot_frequency;
 	
-	/* return gain value */
-	return this->cur_measure 
-		- (left_tot / this->cur_tot * left_measure)
-		- (right_tot / this->cur_tot * left_measure);
+	return combine(left_measure, left_tot, right_measure, right_tot);
+}
+
+gini::gini() {
+
 }
 
 gini::gini(float*& frequency, int n_classes) {
@@ -965,13 +1890,49 @@ gini::~gini() {
 }
 
 float gini::measure(float*& frequency, int n_classes) {
-	float tot_frequency = 0.0, ret = 1.0;
-	for (int c = 0; c < n_classes; c++) tot_frequency += frequency[c];
-	for (int c = 0; c < n_classes; c++) {
-		ret -= (frequency[c] / tot_frequency)*(frequency[c] / tot_frequency);
-	}
 	/* store the tot_frequency for other member funtion to use */
-	this->tot_frequency = tot_frequency;
+	return impurity<0>(frequency, n_classes, this->tot_frequency);
+}
 
-	return ret;
+float gini::gain(float*& left_frequency, float*& right_frequency, int n_classes) {
+	/* the same arithmetic as `measure`, but neither a virtual call nor a store per child */
+	return gain_k<0>(left_frequency, right_frequency, n_classes);
+}
+
+split_workspace::split_workspace(split_mode split, int n_classes) {
+	this->split = split;
+	this->n_classes = n_classes;
+	this->busy = false;
+	this->nested = nullptr;
+	if (split == HISTOGRAM_SPLIT) {
+		/* the histograms are given node by node, see `hist_splitter::set_histograms` */
+		this->s = new hist_splitter(n_classes, nullptr, nullptr, nullptr);
+	} else if (split == RANDOM_SPLIT) {
+		this->s = new random_splitter(n_classes);
+	} else {
+		this->s = new best_splitter(n_classes);
+	}
+	this->cr = new gini();
+}
+
+split_workspace::~split_workspace() {
+	delete this->s;
+	delete this->cr;
+	delete this->nested;
+}
+
+split_workspace* split_workspace::acquire() {
+	split_workspace* ws = this;
+
+	/* the chain is only touched by its worker, so it needs no lock */
+	while (ws->busy) {
+		if (ws->nested == nullptr) ws->nested = new split_workspace(ws->split, ws->n_classes);
+		ws = ws->nested;
+	}
+	ws->busy = true;
+	return ws;
+}
+
+void split_workspace::release() {
+	this->busy = false;
 }